@@ -0,0 +1,109 @@
+#pragma once
+
+// std library headers
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Just enough of a benchmark harness for the bench_* targets
+namespace Bench {
+
+struct Result {
+    std::string name;
+    uint64_t iterations = 0;
+    double ns_per_op = 0.0;
+};
+
+// Stops the optimizer from dropping a value that's never read
+template <typename T> inline void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs f in doubling batches until one batch takes at least min_time
+template <typename F>
+Result run(const std::string &name, F f,
+           std::chrono::milliseconds min_time =
+               std::chrono::milliseconds(200)) {
+    using clock = std::chrono::steady_clock;
+    uint64_t iterations = 1;
+    while (true) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            f();
+        }
+        auto elapsed = clock::now() - start;
+        if (elapsed >= min_time || iterations >= (uint64_t(1) << 40)) {
+            double ns =
+                std::chrono::duration<double, std::nano>(elapsed).count();
+            return {name, iterations, ns / iterations};
+        }
+        iterations *= 2;
+    }
+}
+
+inline void print(const Result &result) {
+    std::cout << std::left << std::setw(40) << result.name << std::right
+              << std::setw(14) << std::fixed << std::setprecision(1)
+              << result.ns_per_op << " ns/op" << std::setw(14)
+              << result.iterations << " iterations" << std::endl;
+}
+
+// Runs every benchmark a few times, reporting the median and spread of the
+// repetitions so numbers from two commits can be compared
+class Suite {
+  public:
+    struct Stats {
+        std::string name;
+        uint64_t iterations = 0;
+        double median_ns = 0.0;
+        double min_ns = 0.0;
+        double max_ns = 0.0;
+    };
+
+    // Only benchmarks whose name contains filter run
+    Suite(int repetitions, std::string filter)
+        : _repetitions(std::max(repetitions, 1)), _filter(filter) {}
+
+    template <typename F> void add(const std::string &name, F f) {
+        if (name.find(_filter) == std::string::npos) {
+            return;
+        }
+        std::vector<double> ns;
+        uint64_t iterations = 0;
+        for (int i = 0; i < _repetitions; i++) {
+            Result result = run(name, f);
+            ns.push_back(result.ns_per_op);
+            iterations = result.iterations;
+        }
+        std::sort(ns.begin(), ns.end());
+        _stats.push_back(
+            {name, iterations, ns[ns.size() / 2], ns.front(), ns.back()});
+        print({name, iterations, ns[ns.size() / 2]});
+    }
+
+    void write_json(std::ostream &out) const {
+        out << "{\n  \"repetitions\": " << _repetitions
+            << ",\n  \"benchmarks\": [";
+        for (size_t i = 0; i < _stats.size(); i++) {
+            const Stats &stats = _stats[i];
+            out << (i == 0 ? "\n" : ",\n") << std::fixed
+                << std::setprecision(3) << "    {\"name\": \"" << stats.name
+                << "\", \"iterations\": " << stats.iterations
+                << ", \"ns_per_op\": " << stats.median_ns
+                << ", \"min_ns_per_op\": " << stats.min_ns
+                << ", \"max_ns_per_op\": " << stats.max_ns << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+  private:
+    int _repetitions;
+    std::string _filter;
+    std::vector<Stats> _stats;
+};
+
+} // namespace Bench
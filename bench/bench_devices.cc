@@ -0,0 +1,169 @@
+// std library headers
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 3rd party headers
+// ---- cxxopts ----
+#include <cxxopts.hpp>
+
+// Local headers
+#include "bench.h"
+#include "devices.h"
+#include "fleet.h"
+#include "format.h"
+#include "graph.h"
+
+using namespace Devices;
+
+std::string write_config(size_t count) {
+    auto path = std::filesystem::temp_directory_path() /
+                ("bench_devices_" + std::to_string(count) + ".toml");
+    std::ofstream out(path);
+    Fleet::Spec spec;
+    spec.devices = count;
+    out << Fleet::to_toml(spec);
+    return path.string();
+}
+
+// Every width has to span the whole history, and columns updated a sample at
+// a time have to match ones computed from scratch. Timing the transform is
+// pointless if it's showing the wrong samples.
+bool check_transform(Device &device) {
+    const int height = 1000;
+    for (auto mode : Graph::all_modes) {
+        for (int width : {1, 40, 120, 199, 200, 250, 800}) {
+            Graph::Transform incremental;
+            incremental.set_mode(mode);
+            for (int i = 0; i < 3 * Device::hist_size / 2; i++) {
+                device.update_value();
+                device.record_value_to_hist();
+                incremental.update(device, width, height);
+            }
+            Graph::Transform full;
+            full.set_mode(mode);
+            const auto &columns = full.update(device, width, height);
+            bool covered = true;
+            if (mode == Graph::Mode::MinMax) {
+                const float *ring = device.get_value_analog_ring();
+                auto [low, high] =
+                    std::minmax_element(ring, ring + Device::hist_size);
+                int shown_low = columns[0].low;
+                int shown_high = columns[0].high;
+                for (const auto &column : columns) {
+                    shown_low = std::min(shown_low, column.low);
+                    shown_high = std::max(shown_high, column.high);
+                }
+                covered = shown_low == static_cast<int>(*low * height) &&
+                          shown_high == static_cast<int>(*high * height);
+            }
+            if (!covered || full.samples() != Device::hist_size ||
+                incremental.update(device, width, height) != columns) {
+                std::cerr << Graph::mode_to_string(mode) << " columns at width "
+                          << width << " don't match the history" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    cxxopts::Options options("bench_devices",
+                             "Microbenchmarks for the devices core.");
+    options.add_options()("j,json", "Also write the results as JSON here.",
+                          cxxopts::value<std::string>())(
+        "r,repetitions", "Runs of each benchmark, the median is reported.",
+        cxxopts::value<int>()->default_value("5"))(
+        "f,filter", "Only run benchmarks whose name contains this.",
+        cxxopts::value<std::string>()->default_value(""));
+    auto result = options.parse(argc, argv);
+    Bench::Suite suite(result["repetitions"].as<int>(),
+                       result["filter"].as<std::string>());
+
+    // Same random walk every run
+    std::srand(1);
+    std::string small_config = write_config(10);
+    std::string large_config = write_config(10000);
+    std::vector<std::unique_ptr<Device>> devices;
+    from_toml(devices, small_config);
+    auto find = [&](Type type) -> Device & {
+        return **std::find_if(devices.begin(), devices.end(), [&](auto &d) {
+            return d->type == type && d->modality == Modality::In;
+        });
+    };
+    Device &digital = find(Type::Digital);
+    // Has a warning, a caution and an optimal range
+    Device &analog = find(Type::Analog);
+
+    if (!check_transform(analog)) {
+        return 1;
+    }
+
+    suite.add("update_value/analog", [&] { analog.update_value(); });
+    suite.add("update_value/digital", [&] { digital.update_value(); });
+    suite.add("record_value_to_hist", [&] { analog.record_value_to_hist(); });
+
+    for (int width : {40, 200, 800}) {
+        std::string suffix = "/" + std::to_string(width);
+        // One new sample per call, what every frame sees
+        suite.add("get_value_transform/incremental" + suffix, [&] {
+            analog.update_value();
+            analog.record_value_to_hist();
+            Bench::keep(analog.get_value_transform(width, 40));
+        });
+        // A new size every call recomputes every column
+        int height = 40;
+        suite.add("get_value_transform/full" + suffix, [&] {
+            height = height == 40 ? 41 : 40;
+            Bench::keep(analog.get_value_transform(width, height));
+        });
+    }
+
+    float value = analog.rel_min.value();
+    float step = (analog.rel_max.value() - analog.rel_min.value()) / 97;
+    suite.add("classify_threshold", [&] {
+        value = value + step > analog.rel_max.value()
+                    ? analog.rel_min.value()
+                    : value + step;
+        Bench::keep(analog.is_warning(value) || analog.is_caution(value) ||
+                    analog.is_optimal(value));
+    });
+    suite.add("find_uncovered_intervals",
+              [&] { Bench::keep(analog.find_uncovered_intervals()); });
+
+    float number = 23.456f;
+    suite.add("float_to_string", [&] {
+        Bench::keep(float_to_string(number));
+        number += 0.01f;
+    });
+
+    suite.add("from_toml/10", [&] {
+        std::vector<std::unique_ptr<Device>> loaded;
+        from_toml(loaded, small_config);
+        Bench::keep(loaded);
+    });
+    suite.add("from_toml/10000", [&] {
+        std::vector<std::unique_ptr<Device>> loaded;
+        from_toml(loaded, large_config);
+        Bench::keep(loaded);
+    });
+    std::filesystem::remove(small_config);
+    std::filesystem::remove(large_config);
+
+    if (result.count("json") > 0) {
+        std::string path = result["json"].as<std::string>();
+        std::ofstream out(path);
+        suite.write_json(out);
+        if (!out) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
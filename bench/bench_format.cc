@@ -0,0 +1,120 @@
+// std library headers
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 3rd party headers
+// ---- ftxui ----
+#include <ftxui/dom/elements.hpp>
+#include <ftxui/screen/screen.hpp>
+
+// Local headers
+#include "bench.h"
+#include "devices.h"
+#include "dui.h"
+#include "format.h"
+
+using namespace Devices;
+
+// What float_to_string used to be
+std::string stream_float_to_string(float value) {
+    std::stringstream stream;
+    stream << std::fixed << std::setprecision(2) << value;
+    return stream.str();
+}
+
+float scaled(const Device &device) {
+    return device.get_value_analog() *
+               (device.rel_max.value() - device.rel_min.value()) +
+           device.rel_min.value();
+}
+
+// Moves a tenth of the fleet each frame, about what the update thread does
+// between two frames
+void step(std::vector<std::unique_ptr<Device>> &devices, size_t &next) {
+    for (size_t i = 0; i < devices.size() / 10; i++) {
+        devices[next]->update_value();
+        next = (next + 1) % devices.size();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t fleet = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    size_t rows = 50;
+
+    std::vector<std::unique_ptr<Device>> devices;
+    for (size_t i = 0; i < fleet; i++) {
+        auto device = std::make_unique<Device>("sensor_" + std::to_string(i),
+                                               i % 40);
+        device->to_analog("Celsius,C", 0, 1023, -20.0f, 60.0f);
+        device->to_in();
+        devices.push_back(std::move(device));
+    }
+    std::cout << "Fleet of " << fleet << " analog devices" << std::endl;
+
+    float value = 23.456f;
+    Bench::print(Bench::run("stringstream float_to_string", [&] {
+        Bench::keep(stream_float_to_string(value));
+        value += 0.01f;
+    }));
+    Bench::print(Bench::run("to_chars float_to_string", [&] {
+        Bench::keep(float_to_string(value));
+        value += 0.01f;
+    }));
+    FloatMemo memo;
+    Bench::print(Bench::run("memo, changing value", [&] {
+        Bench::keep(memo(value));
+        value += 0.01f;
+    }));
+    Bench::print(Bench::run("memo, same value", [&] {
+        Bench::keep(memo(value));
+    }));
+
+    // Value, minimum and maximum for every device, as an overview row needs
+    size_t next = 0;
+    Bench::print(Bench::run("fleet frame, stringstream", [&] {
+        step(devices, next);
+        for (const auto &device : devices) {
+            Bench::keep(stream_float_to_string(scaled(*device)));
+            Bench::keep(stream_float_to_string(device->rel_min.value()));
+            Bench::keep(stream_float_to_string(device->rel_max.value()));
+        }
+    }));
+    std::vector<UI::OverviewText> texts(devices.size());
+    Bench::print(Bench::run("fleet frame, memo", [&] {
+        step(devices, next);
+        for (size_t i = 0; i < devices.size(); i++) {
+            const auto &device = devices[i];
+            Bench::keep(texts[i].value(scaled(*device)));
+            Bench::keep(texts[i].min(device->rel_min.value()));
+            Bench::keep(texts[i].max(device->rel_max.value()));
+        }
+    }));
+
+    // The graph axis colors, which a detail view builds once per config
+    // change, covering the gaps between thresholds on the way
+    Device thresholded("temperature", 0);
+    thresholded.to_analog("Fahrenheit,F", 0, 1023, -20.0f, 135.0f);
+    thresholded.warnings = {{-20.0f, 5.0f}, {105.0f, 135.0f}};
+    thresholded.cautions = {{5.0f, 32.0f}, {95.0f, 105.0f}};
+    thresholded.optimals = {{68.0f, 77.0f}};
+    Bench::print(Bench::run("device_thresholds", [&] {
+        Bench::keep(UI::device_thresholds(thresholded));
+    }));
+
+    // What the overview list builds and draws per frame
+    auto screen = ftxui::Screen::Create(ftxui::Dimension::Fixed(120),
+                                        ftxui::Dimension::Fixed(3));
+    Bench::print(Bench::run("overview rows, " + std::to_string(rows), [&] {
+        step(devices, next);
+        for (size_t i = 0; i < rows && i < devices.size(); i++) {
+            auto row = UI::device_overview(*devices[i], false, texts[i]);
+            ftxui::Render(screen, row);
+        }
+    }));
+    return 0;
+}
@@ -0,0 +1,276 @@
+// std library headers
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 3rd party headers
+// ---- cxxopts ----
+#include <cxxopts.hpp>
+
+// Local headers
+#include "bench.h"
+#include "devices.h"
+#include "fleet.h"
+#include "protocol.h"
+
+using namespace Devices;
+
+// Same cadence as the pipeline and the server
+const int ticks_per_second = 20;
+const int ticks_per_record = 5;
+const int ticks_per_keyframe = 100;
+
+std::vector<std::unique_ptr<Device>> load_fleet(size_t count) {
+    auto path = std::filesystem::temp_directory_path() /
+                ("bench_protocol_" + std::to_string(count) + ".toml");
+    {
+        std::ofstream out(path);
+        Fleet::Spec spec;
+        spec.devices = count;
+        out << Fleet::to_toml(spec);
+    }
+    std::vector<std::unique_ptr<Device>> devices;
+    from_toml(devices, path.string());
+    std::filesystem::remove(path);
+    return devices;
+}
+
+void update(std::vector<std::unique_ptr<Device>> &devices) {
+    for (auto &device : devices) {
+        device->update_value();
+    }
+}
+
+void record(std::vector<std::unique_ptr<Device>> &devices) {
+    for (auto &device : devices) {
+        device->record_value_to_hist();
+    }
+}
+
+// Splits a stream into its frames, in order
+std::vector<std::string> split(const std::string &stream) {
+    std::vector<std::string> frames;
+    size_t offset = 0;
+    size_t start = 0;
+    Protocol::Frame frame;
+    bool error = false;
+    while (Protocol::next_frame(stream, offset, frame, error)) {
+        frames.push_back(stream.substr(start, offset - start));
+        start = offset;
+    }
+    return frames;
+}
+
+bool decode(const std::string &bytes,
+            std::vector<std::unique_ptr<Device>> &devices) {
+    size_t offset = 0;
+    Protocol::Frame frame;
+    bool error = false;
+    if (!Protocol::next_frame(bytes, offset, frame, error)) {
+        return false;
+    }
+    switch (frame.kind) {
+    case Protocol::Kind::Schema:
+        return Protocol::decode_schema(frame, devices);
+    case Protocol::Kind::History:
+        return Protocol::decode_history(frame, devices);
+    case Protocol::Kind::Samples:
+        return Protocol::decode_samples(frame, devices);
+    default:
+        return Protocol::decode_values(frame, devices);
+    }
+}
+
+struct Traffic {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    // What the same frames took with fixed width fields
+    uint64_t fixed_bytes = 0;
+};
+
+void row(const std::string &name, const Traffic &traffic, double seconds) {
+    auto kb_per_s = [&](uint64_t bytes) { return bytes / seconds / 1024.0; };
+    std::cout << std::left << std::setw(12) << name << std::right
+              << std::setw(8) << traffic.frames << std::fixed
+              << std::setprecision(0) << std::setw(12)
+              << (traffic.frames ? traffic.bytes / traffic.frames : 0)
+              << std::setprecision(1) << std::setw(12)
+              << kb_per_s(traffic.bytes) << std::setw(12)
+              << kb_per_s(traffic.fixed_bytes) << std::endl;
+}
+
+// Streams ticks worth of updates the way the server would, then compares
+// what went out with the fixed width encoding each value and sample took
+// before: 8 bytes a device for values, 2 plus 8 a sample for samples.
+void bandwidth(std::vector<std::unique_ptr<Device>> &devices, int ticks) {
+    const uint64_t frame_bytes = Protocol::header_bytes + 1 + 4;
+    Traffic values, keyframes, samples, join;
+    Protocol::Encoder encoder(devices);
+    std::string out;
+    Protocol::encode_schema(out, devices);
+    // The schema was fixed width all along
+    uint64_t schema_bytes = out.size();
+    encoder.history(out);
+    encoder.keyframe(out);
+    join = {3, out.size(),
+            schema_bytes + 2 * frame_bytes +
+                devices.size() * (8 + 8 * Device::hist_size + 8)};
+    for (int tick = 1; tick <= ticks; tick++) {
+        update(devices);
+        if (tick % ticks_per_record == 0) {
+            record(devices);
+        }
+        bool keyframe = tick % ticks_per_keyframe == 0;
+        out.clear();
+        if (encoder.values(out, keyframe)) {
+            Traffic &traffic = keyframe ? keyframes : values;
+            traffic.frames++;
+            traffic.bytes += out.size();
+            traffic.fixed_bytes += frame_bytes + 8 * devices.size();
+        }
+        out.clear();
+        if (encoder.samples(out)) {
+            samples.frames++;
+            samples.bytes += out.size();
+            samples.fixed_bytes += frame_bytes + 10 * devices.size();
+        }
+    }
+    double seconds = static_cast<double>(ticks) / ticks_per_second;
+    std::cout << devices.size() << " devices, " << seconds
+              << " s at " << ticks_per_second << " Hz" << std::endl;
+    std::cout << std::left << std::setw(12) << "frame" << std::right
+              << std::setw(8) << "count" << std::setw(12) << "avg bytes"
+              << std::setw(12) << "KB/s" << std::setw(12) << "fixed KB/s"
+              << std::endl;
+    row("values", values, seconds);
+    row("keyframe", keyframes, seconds);
+    row("samples", samples, seconds);
+    Traffic total{values.frames + keyframes.frames + samples.frames,
+                  values.bytes + keyframes.bytes + samples.bytes,
+                  values.fixed_bytes + keyframes.fixed_bytes +
+                      samples.fixed_bytes};
+    row("total", total, seconds);
+    std::cout << "Joining: " << join.bytes / 1024 << " KB for the schema, "
+              << "history and keyframe, " << join.fixed_bytes / 1024
+              << " KB fixed width" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    cxxopts::Options options(
+        "bench_protocol",
+        "Snapshot protocol throughput and bandwidth for a large fleet.");
+    options.add_options()("j,json", "Also write the results as JSON here.",
+                          cxxopts::value<std::string>())(
+        "r,repetitions", "Runs of each benchmark, the median is reported.",
+        cxxopts::value<int>()->default_value("5"))(
+        "f,filter", "Only run benchmarks whose name contains this.",
+        cxxopts::value<std::string>()->default_value(""))(
+        "d,devices", "Devices in the generated fleet.",
+        cxxopts::value<size_t>()->default_value("10000"))(
+        "s,seconds", "Seconds of streaming for the bandwidth report.",
+        cxxopts::value<int>()->default_value("60"));
+    auto result = options.parse(argc, argv);
+    Bench::Suite suite(result["repetitions"].as<int>(),
+                       result["filter"].as<std::string>());
+
+    // Same random walk every run
+    std::srand(1);
+    auto devices = load_fleet(result["devices"].as<size_t>());
+    if (devices.empty()) {
+        std::cerr << "No devices generated" << std::endl;
+        return 1;
+    }
+    // Fill the history so joins and samples look like a long running server
+    for (int i = 0; i < Device::hist_size; i++) {
+        update(devices);
+        record(devices);
+    }
+    std::string suffix = "/" + std::to_string(devices.size());
+
+    // A tick's worth of updates is part of every values and samples round,
+    // this is how much of it
+    suite.add("update_value pass" + suffix, [&] { update(devices); });
+    suite.add("record_value_to_hist pass" + suffix, [&] { record(devices); });
+
+    Protocol::Encoder encoder(devices);
+    std::string out;
+    suite.add("encode/values" + suffix, [&] {
+        update(devices);
+        out.clear();
+        encoder.values(out, false);
+        Bench::keep(out);
+    });
+    suite.add("encode/keyframe" + suffix, [&] {
+        out.clear();
+        encoder.keyframe(out);
+        Bench::keep(out);
+    });
+    suite.add("encode/samples" + suffix, [&] {
+        record(devices);
+        out.clear();
+        encoder.samples(out);
+        Bench::keep(out);
+    });
+    suite.add("encode/history" + suffix, [&] {
+        out.clear();
+        encoder.history(out);
+        Bench::keep(out);
+    });
+
+    // A mirror fed the same stream a client gets, frames replayed in a loop.
+    // Past the first lap the deltas land on the wrong values, which costs
+    // the decoder the same.
+    std::vector<std::unique_ptr<Device>> mirror;
+    std::string stream;
+    Protocol::encode_schema(stream, devices);
+    encoder.history(stream);
+    encoder.keyframe(stream);
+    auto join = split(stream);
+    for (const auto &frame : join) {
+        decode(frame, mirror);
+    }
+    std::vector<std::string> deltas;
+    std::vector<std::string> recordings;
+    for (int i = 0; i < 64; i++) {
+        update(devices);
+        record(devices);
+        out.clear();
+        encoder.values(out, false);
+        deltas.push_back(out);
+        out.clear();
+        encoder.samples(out);
+        recordings.push_back(out);
+    }
+    size_t next = 0;
+    suite.add("decode/values" + suffix, [&] {
+        Bench::keep(decode(deltas[next++ % deltas.size()], mirror));
+    });
+    suite.add("decode/keyframe" + suffix,
+              [&] { Bench::keep(decode(join[2], mirror)); });
+    next = 0;
+    suite.add("decode/samples" + suffix, [&] {
+        Bench::keep(decode(recordings[next++ % recordings.size()], mirror));
+    });
+    suite.add("decode/history" + suffix,
+              [&] { Bench::keep(decode(join[1], mirror)); });
+
+    std::cout << std::endl;
+    bandwidth(devices, result["seconds"].as<int>() * ticks_per_second);
+
+    if (result.count("json") > 0) {
+        std::string path = result["json"].as<std::string>();
+        std::ofstream out(path);
+        suite.write_json(out);
+        if (!out) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
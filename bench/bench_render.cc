@@ -0,0 +1,165 @@
+// std library headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+// 3rd party headers
+// ---- cxxopts ----
+#include <cxxopts.hpp>
+// ---- ftxui ----
+#include <ftxui/dom/node.hpp>
+#include <ftxui/screen/screen.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "dui.h"
+#include "fleet.h"
+#include "schedule.h"
+
+// Every allocation in the process is counted, frames read the difference
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> allocated_bytes{0};
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size > 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+struct Frames {
+    Frames(const std::string &name) : name(name) {}
+
+    std::string name;
+    std::vector<double> us;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    uint64_t emitted_bytes = 0;
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t i = std::min(values.size() - 1,
+                        static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + i, values.end());
+    return values[i];
+}
+
+void report(const Frames &frames) {
+    size_t n = std::max<size_t>(frames.us.size(), 1);
+    std::printf("%-10s %8zu %10.1f %10.1f %10.1f %12.1f %12.1f %12.1f\n",
+                frames.name.c_str(), frames.us.size(),
+                percentile(frames.us, 0.5), percentile(frames.us, 0.99),
+                *std::max_element(frames.us.begin(), frames.us.end()),
+                static_cast<double>(frames.allocations) / n,
+                static_cast<double>(frames.allocated_bytes) / n,
+                static_cast<double>(frames.emitted_bytes) / n);
+}
+
+int main(int argc, char *argv[]) {
+    cxxopts::Options options("bench_render",
+                             "Renders the device UI offscreen and reports "
+                             "frame times, allocations and output size.");
+    options.add_options()("d,devices", "Devices in the generated config.",
+                          cxxopts::value<size_t>()->default_value("200"))(
+        "w,width", "Screen width.",
+        cxxopts::value<int>()->default_value("160"))(
+        "h,height", "Screen height.",
+        cxxopts::value<int>()->default_value("50"))(
+        "n,frames", "Frames to render.",
+        cxxopts::value<int>()->default_value("2000"))(
+        "s,switch", "Frames between switching tabs.",
+        cxxopts::value<int>()->default_value("100"));
+    auto result = options.parse(argc, argv);
+    size_t count = result["devices"].as<size_t>();
+    int width = result["width"].as<int>();
+    int height = result["height"].as<int>();
+    int frame_count = result["frames"].as<int>();
+    int switch_every = std::max(result["switch"].as<int>(), 1);
+
+    // Goes through the same parser as a real config
+    auto toml_path =
+        std::filesystem::temp_directory_path() / "bench_render.toml";
+    {
+        std::ofstream out(toml_path);
+        Devices::Fleet::Spec spec;
+        spec.devices = count;
+        out << Devices::Fleet::to_toml(spec);
+    }
+    std::vector<std::unique_ptr<Devices::Device>> devices;
+    Devices::from_toml(devices, toml_path.string());
+    std::filesystem::remove(toml_path);
+    if (devices.empty()) {
+        std::cerr << "No devices generated" << std::endl;
+        return 1;
+    }
+
+    std::mutex hist_lock;
+    std::vector<std::unique_ptr<Devices::Schedule::Job>> jobs;
+    Devices::Actuators::SimulatedBackend backend(devices);
+    Devices::Actuators::Queue queue(devices, backend);
+    Devices::Schedule::Scheduler scheduler(jobs, queue, "");
+    Devices::UI::MainView main_view(devices, hist_lock, scheduler, queue);
+    auto renderer = main_view.get_renderer();
+    auto screen = ftxui::Screen::Create(ftxui::Dimension::Fixed(width),
+                                        ftxui::Dimension::Fixed(height));
+
+    std::vector<Frames> tabs = {{"Overview"}, {"Devices"}};
+    for (int frame = 0; frame < frame_count; frame++) {
+        // What the sampling threads do between two frames, left untimed
+        for (auto &device : devices) {
+            device->update_value();
+            device->record_value_to_hist();
+        }
+        size_t tab = (frame / switch_every) % tabs.size();
+        main_view.set_tab(tab);
+
+        uint64_t allocations_before = allocations.load();
+        uint64_t bytes_before = allocated_bytes.load();
+        auto start = std::chrono::steady_clock::now();
+        screen.Clear();
+        auto document = renderer->Render();
+        ftxui::Render(screen, document);
+        std::string output = screen.ToString();
+        auto stop = std::chrono::steady_clock::now();
+
+        auto &frames = tabs[tab];
+        frames.us.push_back(
+            std::chrono::duration<double, std::micro>(stop - start).count());
+        frames.allocations += allocations.load() - allocations_before;
+        frames.allocated_bytes += allocated_bytes.load() - bytes_before;
+        frames.emitted_bytes += output.size();
+    }
+
+    std::printf("%zu devices, %dx%d screen, %d frames\n", devices.size(),
+                width, height, frame_count);
+    std::printf("%-10s %8s %10s %10s %10s %12s %12s %12s\n", "Tab", "Frames",
+                "p50 us", "p99 us", "max us", "allocs/frm", "alloc B/frm",
+                "emit B/frm");
+    for (const auto &frames : tabs) {
+        if (!frames.us.empty()) {
+            report(frames);
+        }
+    }
+    return 0;
+}
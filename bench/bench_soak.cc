@@ -0,0 +1,191 @@
+// std library headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// POSIX headers
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// 3rd party headers
+// ---- cxxopts ----
+#include <cxxopts.hpp>
+// ---- ftxui ----
+#include <ftxui/dom/node.hpp>
+#include <ftxui/screen/screen.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "dui.h"
+#include "fleet.h"
+#include "schedule.h"
+
+struct Settings {
+    Devices::Fleet::Spec spec;
+    std::chrono::seconds duration{10};
+    int fps = 20;
+    int width = 160;
+    int height = 50;
+};
+
+double cpu_seconds(const rusage &usage) {
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Runs the sampling threads at the UI's rates and renders the overview
+// offscreen at the frame rate limit, then prints one row of results
+int soak(const Settings &settings) {
+    auto toml_path = std::filesystem::temp_directory_path() /
+                     ("bench_soak_" + std::to_string(getpid()) + ".toml");
+    {
+        std::ofstream out(toml_path);
+        out << Devices::Fleet::to_toml(settings.spec);
+    }
+    std::vector<std::unique_ptr<Devices::Device>> devices;
+    Devices::from_toml(devices, toml_path.string());
+    std::filesystem::remove(toml_path);
+    if (devices.empty()) {
+        std::cerr << "No devices generated" << std::endl;
+        return 1;
+    }
+
+    std::mutex hist_lock;
+    std::vector<std::unique_ptr<Devices::Schedule::Job>> jobs;
+    Devices::Actuators::SimulatedBackend backend(devices);
+    Devices::Actuators::Queue queue(devices, backend);
+    Devices::Schedule::Scheduler scheduler(jobs, queue, "");
+    Devices::UI::MainView main_view(devices, hist_lock, scheduler, queue);
+    auto renderer = main_view.get_renderer();
+    auto screen =
+        ftxui::Screen::Create(ftxui::Dimension::Fixed(settings.width),
+                              ftxui::Dimension::Fixed(settings.height));
+
+    rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    auto start = std::chrono::steady_clock::now();
+    auto stop = start + settings.duration;
+    std::atomic<bool> run = true;
+    std::atomic<uint64_t> updates{0};
+    std::atomic<uint64_t> records{0};
+    std::thread update_values([&]() {
+        while (run) {
+            using namespace std::chrono_literals;
+            std::this_thread::sleep_for(0.05s);
+            for (auto &device : devices) {
+                device->update_value();
+            }
+            updates += devices.size();
+        }
+    });
+    std::thread record_to_hist([&]() {
+        while (run) {
+            using namespace std::chrono_literals;
+            std::this_thread::sleep_for(0.25s);
+            const std::lock_guard<std::mutex> lg(hist_lock);
+            for (auto &device : devices) {
+                device->record_value_to_hist();
+            }
+            records += devices.size();
+        }
+    });
+
+    std::vector<double> frame_ms;
+    auto frame = std::chrono::microseconds(1000000 / std::max(settings.fps, 1));
+    auto next_frame = start;
+    while (std::chrono::steady_clock::now() < stop) {
+        std::this_thread::sleep_until(next_frame);
+        next_frame += frame;
+        auto frame_start = std::chrono::steady_clock::now();
+        screen.Clear();
+        auto document = renderer->Render();
+        ftxui::Render(screen, document);
+        std::string output = screen.ToString();
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - frame_start)
+                               .count());
+        // A slow frame doesn't queue up a burst of catch up frames
+        next_frame = std::max(next_frame, std::chrono::steady_clock::now());
+    }
+    run = false;
+    update_values.join();
+    record_to_hist.join();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    std::sort(frame_ms.begin(), frame_ms.end());
+    double cpu = cpu_seconds(after) - cpu_seconds(before);
+    std::printf("%9zu %9.0f %9.0f %7.1f %9.2f %9.2f %10.1f %7.1f %10.3f\n",
+                devices.size(), updates / seconds, records / seconds,
+                frame_ms.size() / seconds, frame_ms[frame_ms.size() / 2],
+                frame_ms[frame_ms.size() * 99 / 100],
+                after.ru_maxrss / 1024.0, 100.0 * cpu / seconds,
+                1e6 * cpu / seconds / devices.size());
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    cxxopts::Options options("bench_soak",
+                             "Runs sampling, recording and offscreen "
+                             "rendering on generated fleets for a while.");
+    options.add_options()(
+        "d,devices", "Fleet sizes, each soaked in its own process.",
+        cxxopts::value<std::vector<size_t>>()->default_value(
+            "1000,10000,100000"))(
+        "s,seconds", "How long to soak each fleet.",
+        cxxopts::value<int>()->default_value("10"))(
+        "fps", "Frames rendered per second.",
+        cxxopts::value<int>()->default_value("20"))(
+        "w,width", "Screen width.",
+        cxxopts::value<int>()->default_value("160"))(
+        "h,height", "Screen height.",
+        cxxopts::value<int>()->default_value("50"))(
+        "zones", "Zones the devices are spread over.",
+        cxxopts::value<int>()->default_value("10"));
+    auto result = options.parse(argc, argv);
+    Settings settings;
+    settings.duration =
+        std::chrono::seconds(std::max(result["seconds"].as<int>(), 1));
+    settings.fps = result["fps"].as<int>();
+    settings.width = result["width"].as<int>();
+    settings.height = result["height"].as<int>();
+    settings.spec.zones = result["zones"].as<int>();
+
+    std::printf("%9s %9s %9s %7s %9s %9s %10s %7s %10s\n", "Devices",
+                "Updates/s", "Records/s", "FPS", "p50 ms", "p99 ms",
+                "Max RSS MB", "CPU %", "CPU us/dev");
+    std::fflush(stdout);
+    int ret = 0;
+    for (size_t count : result["devices"].as<std::vector<size_t>>()) {
+        settings.spec.devices = count;
+        // A process per fleet so each gets its own memory high-water mark
+        pid_t pid = fork();
+        if (pid == 0) {
+            int status = soak(settings);
+            std::fflush(stdout);
+            _exit(status);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            std::cerr << "Soak of " << count << " devices failed" << std::endl;
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,216 @@
+// std library headers
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 3rd party headers
+// ---- tomlplusplus ----
+#include <toml++/toml.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "events.h"
+#include "wal.h"
+
+using namespace Devices;
+using namespace Devices::Actuators;
+
+void SimulatedBackend::write(const std::vector<Write> &batch) {
+    for (const auto &write : batch) {
+        _devices[write.device]->set_value_scaled(write.value);
+    }
+}
+
+Queue::Queue(const std::vector<std::unique_ptr<Device>> &devices,
+             Backend &backend)
+    : _devices(devices), _backend(backend), _slots(devices.size()) {
+    for (size_t i = 0; i < devices.size(); i++) {
+        _slots[i].current = devices[i]->get_value_scaled();
+    }
+    _batch.reserve(devices.size());
+}
+
+void Queue::set_limits(size_t device, const Limits &limits) {
+    const std::lock_guard<std::mutex> lg(_lock);
+    _slots[device].limits = limits;
+}
+
+void Queue::set_log(Wal::Log *log) {
+    const std::lock_guard<std::mutex> lg(_lock);
+    _log = log;
+}
+
+void Queue::submit(size_t device, float value, Source source,
+                   Clock::time_point sampled) {
+    auto now = Clock::now();
+    const std::lock_guard<std::mutex> lg(_lock);
+    auto &slot = _slots[device];
+    // Other writers and attached servers move devices too, compare with
+    // where it is now rather than what this queue last wrote
+    slot.current = _devices[device]->get_value_scaled();
+    _counters.submitted++;
+    if (slot.pending) {
+        // Last writer wins, the earlier command is never written
+        _counters.coalesced++;
+    } else if (value == slot.current) {
+        _counters.redundant++;
+        return;
+    } else {
+        slot.pending = true;
+        slot.first_submitted = now;
+        _counters.depth++;
+    }
+    slot.command = {device, value, source, sampled};
+    slot.last_submitted = now;
+    if (_log != nullptr) {
+        _log->append(Wal::Kind::Command, _devices[device]->name, value);
+    }
+    Events::command(device, value, source);
+}
+
+bool Queue::is_allowed(const Slot &slot, Clock::time_point now) const {
+    if (_devices[slot.command.device]->type == Type::Digital) {
+        bool on = slot.current != 0.0f;
+        auto held = now - slot.last_switch;
+        if (on && held < slot.limits.min_on) {
+            return false;
+        }
+        if (!on && held < slot.limits.min_off) {
+            return false;
+        }
+    }
+    return slot.limits.max_switches_per_min == 0 ||
+           static_cast<int>(slot.switches.size()) <
+               slot.limits.max_switches_per_min;
+}
+
+void Queue::flush(Clock::time_point now) {
+    using namespace std::chrono;
+
+    {
+        const std::lock_guard<std::mutex> lg(_lock);
+        _batch.clear();
+        for (auto &slot : _slots) {
+            if (!slot.pending || now - slot.first_submitted <
+                                     slot.limits.coalesce) {
+                continue;
+            }
+            slot.current = _devices[slot.command.device]->get_value_scaled();
+            if (slot.command.value == slot.current) {
+                // Toggled back to where it started within the window
+                slot.pending = false;
+                _counters.depth--;
+                _counters.redundant++;
+                continue;
+            }
+            while (!slot.switches.empty() &&
+                   now - slot.switches.front() >= minutes(1)) {
+                slot.switches.pop_front();
+            }
+            if (!is_allowed(slot, now)) {
+                _counters.deferred++;
+                continue;
+            }
+            _batch.push_back(slot.command);
+            slot.pending = false;
+            _counters.depth--;
+            slot.current = slot.command.value;
+            slot.last_switch = now;
+            if (slot.limits.max_switches_per_min > 0) {
+                slot.switches.push_back(now);
+            }
+            int64_t latency =
+                duration_cast<nanoseconds>(now - slot.first_submitted)
+                    .count();
+            if (latency > _counters.max_latency_ns.load()) {
+                _counters.max_latency_ns.store(latency);
+            }
+            latency = duration_cast<nanoseconds>(now - slot.command.sampled)
+                          .count();
+            if (latency > _counters.max_sample_latency_ns.load()) {
+                _counters.max_sample_latency_ns.store(latency);
+            }
+        }
+    }
+    // One write per tick no matter how many actuators changed
+    if (!_batch.empty()) {
+        _backend.write(_batch);
+        _counters.written += _batch.size();
+        _counters.batches++;
+        if (_log != nullptr) {
+            for (const auto &write : _batch) {
+                _log->append(Wal::Kind::Ack, _devices[write.device]->name,
+                             write.value);
+            }
+        }
+        for (const auto &write : _batch) {
+            Events::write(write.device, write.value, write.source);
+        }
+    }
+}
+
+std::string Queue::info() const {
+    std::ostringstream oss;
+    oss << "------------------------" << std::endl;
+    oss << "Actuator Commands" << std::endl;
+    oss << "Submitted: " << _counters.submitted.load() << std::endl;
+    oss << "Written: " << _counters.written.load() << " in "
+        << _counters.batches.load() << " batches" << std::endl;
+    oss << "Coalesced: " << _counters.coalesced.load() << std::endl;
+    oss << "Redundant: " << _counters.redundant.load() << std::endl;
+    oss << "Deferred: " << _counters.deferred.load() << std::endl;
+    oss << "Queue depth: " << _counters.depth.load() << std::endl;
+    oss << "Max latency: " << _counters.max_latency_ns.load() / 1000000
+        << " ms" << std::endl;
+    oss << "Max sample to write latency: "
+        << _counters.max_sample_latency_ns.load() / 1000000 << " ms"
+        << std::endl;
+    oss << "------------------------" << std::endl;
+    return oss.str();
+}
+
+void Actuators::from_toml(Queue &queue,
+                          const std::vector<std::unique_ptr<Device>> &devices,
+                          const std::string &toml_path) {
+    try {
+        auto config = toml::parse_file(toml_path);
+        if (!config["Actuators"].is_array_of_tables()) {
+            return;
+        }
+        for (auto &&actuator : *config["Actuators"].as_array()) {
+            auto &a_table = *actuator.as_table();
+            std::string name = a_table["name"].value<std::string>().value();
+            auto it = std::find_if(
+                devices.begin(), devices.end(),
+                [&](const auto &device) { return device->name == name; });
+            if (it == devices.end() || (*it)->modality != Modality::InOut) {
+                std::cerr << "Skipping actuator limits for " << name
+                          << ": not an InOut device" << std::endl;
+                continue;
+            }
+            Limits limits;
+            limits.coalesce = std::chrono::milliseconds(
+                a_table["coalesce_ms"].value_or<int64_t>(
+                    limits.coalesce.count()));
+            limits.min_on = std::chrono::milliseconds(
+                a_table["min_on_ms"].value_or<int64_t>(0));
+            limits.min_off = std::chrono::milliseconds(
+                a_table["min_off_ms"].value_or<int64_t>(0));
+            limits.max_switches_per_min =
+                a_table["max_switches_per_min"].value_or(0);
+            queue.set_limits(it - devices.begin(), limits);
+        }
+    } catch (const toml::parse_error &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    } catch (const std::bad_optional_access &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    }
+}
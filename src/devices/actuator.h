@@ -0,0 +1,156 @@
+#pragma once
+
+// std library headers
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Local headers
+#include "devices.h"
+
+namespace Devices {
+
+namespace Wal {
+class Log;
+} // namespace Wal
+
+namespace Actuators {
+
+using Clock = std::chrono::steady_clock;
+
+// Remote is a view attached over the socket, UI the local one
+enum class Source { UI, Schedule, Control, Recovery, Remote };
+
+const std::array<Source, 5> all_sources = {Source::UI, Source::Schedule,
+                                           Source::Control, Source::Recovery,
+                                           Source::Remote};
+
+inline std::string source_to_string(Source source) {
+    switch (source) {
+    case Source::UI:
+        return "UI";
+    case Source::Schedule:
+        return "Schedule";
+    case Source::Control:
+        return "Control";
+    case Source::Recovery:
+        return "Recovery";
+    case Source::Remote:
+        return "Remote";
+    default:
+        return "Unknown";
+    }
+}
+
+// Per-actuator protection, zero disables a limit
+struct Limits {
+    // Commands arriving within this long of the first are merged
+    std::chrono::milliseconds coalesce{100};
+    // Digital actuators only, how long to hold a state before leaving it
+    std::chrono::milliseconds min_on{0};
+    std::chrono::milliseconds min_off{0};
+    int max_switches_per_min = 0;
+};
+
+// A value to write to a device, in its relative units
+struct Write {
+    size_t device;
+    float value;
+    Source source;
+    // When the inputs the value was computed from were read
+    Clock::time_point sampled{};
+};
+
+// Whatever actually talks to the I/O bus, written to once per flush
+class Backend {
+  public:
+    virtual ~Backend() = default;
+    virtual void write(const std::vector<Write> &batch) = 0;
+};
+
+// Stands in for real hardware by storing straight into the devices
+class SimulatedBackend : public Backend {
+  public:
+    explicit SimulatedBackend(
+        const std::vector<std::unique_ptr<Device>> &devices)
+        : _devices(devices) {}
+    void write(const std::vector<Write> &batch) override;
+
+  private:
+    const std::vector<std::unique_ptr<Device>> &_devices;
+};
+
+struct Counters {
+    std::atomic<uint64_t> submitted{0};
+    // Replaced by a later command before being written
+    std::atomic<uint64_t> coalesced{0};
+    // Already matched the actuator state
+    std::atomic<uint64_t> redundant{0};
+    // Flushes that held a command back for min on/off time or switch rate
+    std::atomic<uint64_t> deferred{0};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> batches{0};
+    // Commands waiting to be written
+    std::atomic<uint64_t> depth{0};
+    std::atomic<int64_t> max_latency_ns{0};
+    // Longest from a command's inputs being sampled to it being written
+    std::atomic<int64_t> max_sample_latency_ns{0};
+};
+
+// Single slot per actuator command queue. Any thread can submit, last writer
+// wins until the slot is flushed, and flush() turns everything that's due
+// into a single backend write.
+class Queue {
+  public:
+    Queue(const std::vector<std::unique_ptr<Device>> &devices,
+          Backend &backend);
+
+    void set_limits(size_t device, const Limits &limits);
+    // Accepted commands and written values get logged here when set
+    void set_log(Wal::Log *log);
+    // Sampled defaults to now, for commands that don't read any inputs
+    void submit(size_t device, float value, Source source,
+                Clock::time_point sampled = Clock::now());
+    void flush(Clock::time_point now);
+
+    const Counters &counters() const { return _counters; }
+    std::string info() const;
+
+  private:
+    struct Slot {
+        Limits limits;
+        bool pending = false;
+        Write command;
+        Clock::time_point first_submitted;
+        Clock::time_point last_submitted;
+        // Device value as last read, refreshed on every submit and flush
+        float current = 0.0f;
+        Clock::time_point last_switch;
+        // Recent switch times for rate limiting
+        std::deque<Clock::time_point> switches;
+    };
+
+    const std::vector<std::unique_ptr<Device>> &_devices;
+    Backend &_backend;
+    Wal::Log *_log = nullptr;
+    std::vector<Slot> _slots;
+    std::vector<Write> _batch;
+    Counters _counters;
+    std::mutex _lock;
+
+    bool is_allowed(const Slot &slot, Clock::time_point now) const;
+};
+
+void from_toml(Queue &queue,
+               const std::vector<std::unique_ptr<Device>> &devices,
+               const std::string &toml_path);
+
+} // namespace Actuators
+
+} // namespace Devices
@@ -0,0 +1,33 @@
+#pragma once
+
+// std library headers
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace Devices {
+
+namespace Bytes {
+
+// Fixed width fields in host byte order, for the files only this host reads
+
+template <typename T> void append(std::string &buffer, T value) {
+    buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Overwrites a field appended earlier
+template <typename T> void put(std::string &buffer, size_t offset, T value) {
+    std::memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+// The caller checks the size, offset is moved past the field
+template <typename T> T get(const char *data, size_t &offset) {
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+} // namespace Bytes
+
+} // namespace Devices
@@ -0,0 +1,285 @@
+// std library headers
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 3rd party headers
+// ---- tomlplusplus ----
+#include <toml++/toml.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "control.h"
+#include "devices.h"
+#include "events.h"
+#include "expr.h"
+
+using namespace Devices;
+using namespace Devices::Control;
+
+std::string
+Loop::info(const std::vector<std::unique_ptr<Device>> &devices) const {
+    std::ostringstream oss;
+    oss << "------------------------" << std::endl;
+    oss << "Controller Name: " << name << std::endl;
+    oss << "Kind: " << kind_to_string(kind) << std::endl;
+    if (kind != Kind::Rule) {
+        oss << "Sensor: " << devices[sensor]->name << std::endl;
+    }
+    oss << "Actuator: " << devices[actuator]->name << std::endl;
+    oss << "Period: " << period.count() << " ms" << std::endl;
+    switch (kind) {
+    case Kind::Hysteresis:
+        oss << "On " << (active_below ? "below: " : "above: ")
+            << float_to_string(on) << std::endl;
+        oss << "Off " << (active_below ? "above: " : "below: ")
+            << float_to_string(off) << std::endl;
+        break;
+    case Kind::PID:
+        oss << "Setpoint: " << float_to_string(setpoint) << std::endl;
+        oss << "Gains: kp=" << kp << " ki=" << ki << " kd=" << kd
+            << std::endl;
+        break;
+    case Kind::Rule:
+        break;
+    }
+    oss << "Ticks: " << stats.ticks.load() << std::endl;
+    oss << "Overruns: " << stats.overruns.load() << std::endl;
+    oss << "Compute latency (last/max): " << stats.last_compute_ns.load() / 1000
+        << "/" << stats.max_compute_ns.load() / 1000 << " us" << std::endl;
+    oss << "Max jitter: " << stats.max_jitter_ns.load() / 1000 << " us"
+        << std::endl;
+    oss << "------------------------" << std::endl;
+    return oss.str();
+}
+
+// Actuator output range in relative units, digital actuators are 0 or 1
+std::pair<float, float> output_range(const Device &device) {
+    if (device.type == Type::Analog) {
+        return {device.rel_min.value(), device.rel_max.value()};
+    }
+    return {0.0f, 1.0f};
+}
+
+float Loop::compute(const std::vector<std::unique_ptr<Device>> &devices,
+                    float dt, float *inputs, float *stack) {
+    auto [low, high] = output_range(*devices[actuator]);
+    switch (kind) {
+    case Kind::Hysteresis: {
+        float value = devices[sensor]->get_value_scaled();
+        if (active_below) {
+            if (value < on) {
+                _active = true;
+            } else if (value > off) {
+                _active = false;
+            }
+        } else {
+            if (value > on) {
+                _active = true;
+            } else if (value < off) {
+                _active = false;
+            }
+        }
+        return _active ? high : low;
+    }
+    case Kind::PID: {
+        float error = setpoint - devices[sensor]->get_value_scaled();
+        float derivative =
+            (_has_previous && dt > 0.0f) ? (error - _previous_error) / dt
+                                         : 0.0f;
+        _previous_error = error;
+        _has_previous = true;
+        float integral = _integral + error * dt;
+        float output = bias + kp * error + ki * integral + kd * derivative;
+        // Conditional integration, don't wind up while saturated
+        if (output > high) {
+            output = high;
+        } else if (output < low) {
+            output = low;
+        } else {
+            _integral = integral;
+        }
+        if (devices[actuator]->type == Type::Digital) {
+            output = (output >= 0.5f) ? 1.0f : 0.0f;
+        }
+        return output;
+    }
+    case Kind::Rule: {
+        for (auto input : rule->inputs()) {
+            inputs[input] = devices[input]->get_value_scaled();
+        }
+        return rule->evaluate(inputs, stack);
+    }
+    }
+    return low;
+}
+
+void Loop::step(const std::vector<std::unique_ptr<Device>> &devices,
+                Actuators::Queue &queue, Clock::time_point due, float *inputs,
+                float *stack) {
+    using namespace std::chrono;
+
+    auto sampled = Clock::now();
+    float dt = _has_previous
+                   ? duration<float>(sampled - _last_sample).count()
+                   : duration<float>(period).count();
+    _last_sample = sampled;
+    float output = compute(devices, dt, inputs, stack);
+    queue.submit(actuator, output, Actuators::Source::Control, sampled);
+    auto submitted = Clock::now();
+
+    int64_t latency = duration_cast<nanoseconds>(submitted - sampled).count();
+    int64_t jitter = duration_cast<nanoseconds>(sampled - due).count();
+    stats.ticks++;
+    stats.last_compute_ns.store(latency);
+    if (latency > stats.max_compute_ns.load()) {
+        stats.max_compute_ns.store(latency);
+    }
+    if (jitter > stats.max_jitter_ns.load()) {
+        stats.max_jitter_ns.store(jitter);
+    }
+
+    // Stay on the fixed grid, skipping (and counting) missed ticks
+    auto missed = (sampled - due) / period;
+    if (missed > 0) {
+        stats.overruns += missed;
+    }
+    _next_due = due + period * (missed + 1);
+}
+
+Engine::Engine(std::vector<std::unique_ptr<Loop>> &loops,
+               const std::vector<std::unique_ptr<Device>> &devices,
+               Actuators::Queue &queue)
+    : _loops(loops), _devices(devices), _queue(queue),
+      _inputs(devices.size(), 0.0f) {
+    size_t stack_depth = 1;
+    auto now = Loop::Clock::now();
+    for (auto &loop : _loops) {
+        if (loop->rule) {
+            stack_depth = std::max(stack_depth, loop->rule->stack_depth());
+        }
+        loop->start(now);
+    }
+    _stack.resize(stack_depth);
+}
+
+Loop::Clock::time_point Engine::step() {
+    using namespace std::chrono_literals;
+
+    auto now = Loop::Clock::now();
+    auto next = now + 1s;
+    for (auto &loop : _loops) {
+        if (loop->next_due() <= now) {
+            loop->step(_devices, _queue, loop->next_due(), _inputs.data(),
+                       _stack.data());
+        }
+        next = std::min(next, loop->next_due());
+    }
+    return next;
+}
+
+size_t find_device(const std::vector<std::unique_ptr<Device>> &devices,
+                   const std::string &name) {
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (devices[i]->name == name) {
+            return i;
+        }
+    }
+    throw std::out_of_range("Unknown device " + name);
+}
+
+void Control::from_toml(std::vector<std::unique_ptr<Loop>> &loops,
+                        std::vector<std::unique_ptr<Device>> &devices,
+                        const std::string &toml_path) {
+    try {
+        auto config = toml::parse_file(toml_path);
+
+        for (auto kind : all_kinds) {
+            std::string kind_str = kind_to_string(kind);
+            if (!config["Controllers"][kind_str].is_array_of_tables()) {
+                continue;
+            }
+            for (auto &&controller :
+                 *config["Controllers"][kind_str].as_array()) {
+                auto &c_table = *controller.as_table();
+                std::string name = c_table["name"].value<std::string>().value();
+                auto loop = std::make_unique<Loop>(name, kind);
+                loop->actuator = find_device(
+                    devices, c_table["actuator"].value<std::string>().value());
+                loop->period = std::chrono::milliseconds(
+                    c_table["period_ms"].value_or<int64_t>(1000));
+                // Ticks are counted by dividing by the period
+                if (loop->period.count() <= 0) {
+                    std::string error = "controller " + name +
+                                        ": period_ms must be positive";
+                    std::cerr << "Failed to parse TOML: " << error
+                              << std::endl;
+                    Events::config(toml_path, error);
+                    continue;
+                }
+                if (devices[loop->actuator]->modality != Modality::InOut) {
+                    std::cerr << "Skipping controller " << name << ": "
+                              << devices[loop->actuator]->name
+                              << " is not an InOut device" << std::endl;
+                    continue;
+                }
+
+                // Handle kind-specific fields
+                switch (kind) {
+                case Kind::Hysteresis: {
+                    loop->sensor = find_device(
+                        devices,
+                        c_table["sensor"].value<std::string>().value());
+                    loop->active_below = static_cast<bool>(c_table["on_below"]);
+                    if (loop->active_below) {
+                        loop->on = c_table["on_below"].value<float>().value();
+                        loop->off = c_table["off_above"].value<float>().value();
+                    } else {
+                        loop->on = c_table["on_above"].value<float>().value();
+                        loop->off = c_table["off_below"].value<float>().value();
+                    }
+                    break;
+                }
+                case Kind::PID: {
+                    loop->sensor = find_device(
+                        devices,
+                        c_table["sensor"].value<std::string>().value());
+                    loop->setpoint = c_table["setpoint"].value<float>().value();
+                    loop->kp = c_table["kp"].value_or(0.0f);
+                    loop->ki = c_table["ki"].value_or(0.0f);
+                    loop->kd = c_table["kd"].value_or(0.0f);
+                    loop->bias = c_table["bias"].value_or(0.0f);
+                    break;
+                }
+                case Kind::Rule: {
+                    std::string error;
+                    loop->rule = Expressions::Program::compile(
+                        c_table["rule"].value<std::string>().value(), devices,
+                        error);
+                    if (!loop->rule) {
+                        std::cerr << "Skipping controller " << name << ": "
+                                  << error << std::endl;
+                        continue;
+                    }
+                    break;
+                }
+                }
+                devices[loop->actuator]->drive();
+                loops.push_back(std::move(loop));
+            }
+        }
+    } catch (const toml::parse_error &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    } catch (const std::out_of_range &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    } catch (const std::bad_optional_access &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+// std library headers
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "expr.h"
+
+namespace Devices {
+
+namespace Control {
+
+enum class Kind { Hysteresis, PID, Rule };
+
+const std::array<Kind, 3> all_kinds = {Kind::Hysteresis, Kind::PID,
+                                       Kind::Rule};
+
+inline std::string kind_to_string(Kind kind) {
+    switch (kind) {
+    case Kind::Hysteresis:
+        return "Hysteresis";
+    case Kind::PID:
+        return "PID";
+    case Kind::Rule:
+        return "Rule";
+    default:
+        return "Unknown";
+    }
+}
+
+// Written by the control thread, read by anyone
+struct Stats {
+    std::atomic<uint64_t> ticks{0};
+    // Ticks that started a full period or more after they were due
+    std::atomic<uint64_t> overruns{0};
+    // Time from sampling the sensor to submitting the actuator command. The
+    // queue reports how much longer the write itself took.
+    std::atomic<int64_t> last_compute_ns{0};
+    std::atomic<int64_t> max_compute_ns{0};
+    // Time from the tick being due to it starting
+    std::atomic<int64_t> max_jitter_ns{0};
+};
+
+// A single control loop binding a sensor to an InOut actuator, all values are
+// in the devices' relative units
+class Loop {
+
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    std::string name;
+    Kind kind;
+    size_t sensor = 0;
+    size_t actuator = 0;
+    std::chrono::milliseconds period{1000};
+    // Hysteresis: activate past on, deactivate past off
+    float on = 0.0f;
+    float off = 0.0f;
+    bool active_below = true;
+    // PID: output is bias + kp*e + ki*integral(e) + kd*de/dt
+    float setpoint = 0.0f;
+    float kp = 0.0f;
+    float ki = 0.0f;
+    float kd = 0.0f;
+    float bias = 0.0f;
+    // Rule: actuator follows the expression, rules have no sensor
+    std::unique_ptr<Expressions::Program> rule;
+
+    Stats stats;
+
+    Loop(std::string name, Kind kind) : name(name), kind(kind){};
+
+    std::string info(
+        const std::vector<std::unique_ptr<Device>> &devices) const;
+
+    // Samples, computes and actuates once, inputs and stack are scratch
+    // space sized for the device list and the rule's stack depth
+    void step(const std::vector<std::unique_ptr<Device>> &devices,
+              Actuators::Queue &queue, Clock::time_point due, float *inputs,
+              float *stack);
+
+    Clock::time_point next_due() const { return _next_due; }
+    void start(Clock::time_point now) { _next_due = now; }
+
+  private:
+    Clock::time_point _next_due;
+    Clock::time_point _last_sample;
+    bool _active = false;
+    bool _has_previous = false;
+    float _integral = 0.0f;
+    float _previous_error = 0.0f;
+
+    float compute(const std::vector<std::unique_ptr<Device>> &devices,
+                  float dt, float *inputs, float *stack);
+};
+
+// Runs every loop on its own fixed period from a single thread
+class Engine {
+  public:
+    Engine(std::vector<std::unique_ptr<Loop>> &loops,
+           const std::vector<std::unique_ptr<Device>> &devices,
+           Actuators::Queue &queue);
+
+    // Steps every loop that is due and returns when the next one is
+    Loop::Clock::time_point step();
+    size_t size() const { return _loops.size(); }
+
+  private:
+    std::vector<std::unique_ptr<Loop>> &_loops;
+    const std::vector<std::unique_ptr<Device>> &_devices;
+    Actuators::Queue &_queue;
+    std::vector<float> _inputs;
+    std::vector<float> _stack;
+};
+
+void from_toml(std::vector<std::unique_ptr<Loop>> &loops,
+               std::vector<std::unique_ptr<Device>> &devices,
+               const std::string &toml_path);
+
+} // namespace Control
+
+} // namespace Devices
@@ -1,7 +1,6 @@
 // std library headers
 #include <algorithm>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <mutex>
 #include <sstream>
@@ -15,6 +14,7 @@
 
 // Local headers
 #include "devices.h"
+#include "trace.h"
 
 using namespace Devices;
 
@@ -62,11 +62,19 @@ std::string Device::info() const {
                 << std::endl;
         }
     }
+    if (expression.has_value()) {
+        oss << "Expression: " << expression.value() << std::endl;
+    }
     oss << "------------------------" << std::endl;
     return oss.str();
 }
 
 void Device::update_value() {
+    // Derived devices are driven by the expression engine, actuators by
+    // whoever controls them
+    if (modality == Modality::Derived || is_driven()) {
+        return;
+    }
     float rand = static_cast<float>(std::rand()) / RAND_MAX;
     switch (type) {
     case Type::Analog: {
@@ -75,19 +83,24 @@ void Device::update_value() {
             if (val <= 0.0f) {
                 val = 0.01f; // Ensure value does not go below 0
             }
-            _value_analog.store(val);
+            if (_value_analog.exchange(val) != val) {
+                changed();
+            }
         } else if (rand >= 0.6) {
             float val = _value_analog + 0.005;
             if (val >= 1.0f) {
                 val = 0.99f; // Ensure value does not go above 1
             }
-            _value_analog.store(val);
+            if (_value_analog.exchange(val) != val) {
+                changed();
+            }
         }
         break;
     }
     case Type::Digital: {
         if (rand >= 0.99) {
             _value_digital.store((_value_digital == 1) ? 0 : 1);
+            changed();
         }
         break;
     }
@@ -96,45 +109,90 @@ void Device::update_value() {
     }
 }
 
-void Device::record_value_to_hist() {
-    std::rotate(_value_analog_hist.begin(), _value_analog_hist.begin() + 1,
-                _value_analog_hist.end());
-    std::rotate(_value_digital_hist.begin(), _value_digital_hist.begin() + 1,
-                _value_digital_hist.end());
-    _value_analog_hist[hist_size - 1] = _value_analog.load();
-    _value_digital_hist[hist_size - 1] = _value_digital.load();
+float Device::get_value_scaled() const {
+    switch (type) {
+    case Type::Analog:
+        return get_value_analog() * (rel_max.value() - rel_min.value()) +
+               rel_min.value();
+    case Type::Digital: {
+        bool high = get_value_digital() != 0;
+        return (high != is_active_low.value()) ? 1.0f : 0.0f;
+    }
+    }
+    return 0.0f;
 }
 
-std::vector<int> Device::get_value_analog_transform(int width,
-                                                    int height) const {
-    auto vals = get_value_analog_hist();
-    std::vector<int> transform;
-    for (int i = 0; i < width; i++) {
-        int index = vals.size() * i / width;
-        transform.push_back(vals[index] * height);
+void Device::set_value_scaled(float value) {
+    switch (type) {
+    case Type::Analog: {
+        float normalized =
+            (value - rel_min.value()) / (rel_max.value() - rel_min.value());
+        // Also catches NaN from bad expressions
+        if (!(normalized >= 0.0f)) {
+            normalized = 0.0f;
+        } else if (normalized > 1.0f) {
+            normalized = 1.0f;
+        }
+        if (_value_analog.exchange(normalized) != normalized) {
+            changed();
+        }
+        break;
+    }
+    case Type::Digital: {
+        bool active = value != 0.0f;
+        int digital = (active != is_active_low.value()) ? 1 : 0;
+        if (_value_digital.exchange(digital) != digital) {
+            changed();
+        }
+        break;
+    }
     }
-    return transform;
 }
 
-std::vector<int> Device::get_value_digital_transform(int width,
-                                                     int height) const {
-    auto vals = get_value_digital_hist();
-    std::vector<int> transform;
-    for (int i = 0; i < width; i++) {
-        int index = vals.size() * i / width;
-        transform.push_back(vals[index] * height);
-    }
-    return transform;
+void Device::record_value_to_hist() {
+    append_hist(_value_analog.load(), _value_digital.load());
 }
 
-std::vector<int> Device::get_value_transform(int width, int height) const {
-    switch (type) {
-    case Type::Analog:
-        return get_value_analog_transform(width, height);
-    case Type::Digital:
-        return get_value_digital_transform(width, height);
+void Device::append_hist(float analog, int digital) {
+    size_t slot = _hist_generation.load() % hist_size;
+    _value_analog_hist[slot] = analog;
+    _value_digital_hist[slot] = digital;
+    _hist_generation.fetch_add(1, std::memory_order_relaxed);
+    changed();
+}
+
+void Device::set_values(float analog, int digital) {
+    bool moved = _value_analog.exchange(analog) != analog;
+    moved = _value_digital.exchange(digital) != digital || moved;
+    if (moved) {
+        changed();
     }
-    return {};
+}
+
+void Device::restore_hist(uint64_t generation, const float *analog,
+                          const int *digital) {
+    std::copy(analog, analog + hist_size, _value_analog_hist.begin());
+    std::copy(digital, digital + hist_size, _value_digital_hist.begin());
+    _hist_generation.store(generation);
+    changed();
+}
+
+std::array<float, Device::hist_size> Device::get_value_analog_hist() const {
+    std::array<float, hist_size> hist;
+    size_t head = _hist_generation.load() % hist_size;
+    std::rotate_copy(_value_analog_hist.begin(),
+                     _value_analog_hist.begin() + head,
+                     _value_analog_hist.end(), hist.begin());
+    return hist;
+}
+
+std::array<int, Device::hist_size> Device::get_value_digital_hist() const {
+    std::array<int, hist_size> hist;
+    size_t head = _hist_generation.load() % hist_size;
+    std::rotate_copy(_value_digital_hist.begin(),
+                     _value_digital_hist.begin() + head,
+                     _value_digital_hist.end(), hist.begin());
+    return hist;
 }
 
 bool in_intervals(float value,
@@ -174,7 +232,8 @@ void parse_pairs(toml::v3::table *table, const std::string key,
     }
 }
 
-std::vector<std::pair<float, float>> Device::find_uncovered_intervals() {
+std::vector<std::pair<float, float>>
+Device::find_uncovered_intervals() const {
     std::vector<std::pair<float, float>> intervals;
     intervals.insert(intervals.end(), warnings.begin(), warnings.end());
     intervals.insert(intervals.end(), cautions.begin(), cautions.end());
@@ -217,47 +276,9 @@ std::vector<std::pair<float, float>> Device::find_uncovered_intervals() {
     return result;
 }
 
-void Device::set_ui_thresholds() {
-    using namespace ftxui;
-
-    ui_thresholds = color(Color::Default);
-
-    if (type == Type::Analog) {
-        auto uncovered = find_uncovered_intervals();
-        std::map<std::pair<float, float>, Color> intervals_to_color;
-        auto add_to_map =
-            [](std::map<std::pair<float, float>, Color> &intervals_to_color,
-               const std::vector<std::pair<float, float>> &intervals,
-               Color color) {
-                for (auto &interval : intervals) {
-                    intervals_to_color[interval] = color;
-                }
-            };
-        add_to_map(intervals_to_color, warnings, Color::Red1);
-        add_to_map(intervals_to_color, cautions, Color::Yellow1);
-        add_to_map(intervals_to_color, optimals, Color::Green1);
-        add_to_map(intervals_to_color, uncovered, Color::Default);
-        LinearGradient lg = LinearGradient().Angle(270);
-        auto set_stops = [this](LinearGradient &lg,
-                                const std::map<std::pair<float, float>, Color>
-                                    &intervals_to_color) {
-            auto normalize = [this](float value) {
-                return (value - rel_min.value()) /
-                       (rel_max.value() - rel_min.value());
-            };
-            for (const auto &[interval, color] : intervals_to_color) {
-                auto min = normalize(interval.first);
-                auto max = normalize(interval.second);
-                lg = lg.Stop(color, min).Stop(color, max);
-            }
-        };
-        set_stops(lg, intervals_to_color);
-        ui_thresholds = color(lg);
-    }
-}
-
 void Devices::from_toml(std::vector<std::unique_ptr<Device>> &devices,
                         const std::string &toml_path) {
+    TRACE_SPAN("from_toml");
     try {
         auto config = toml::parse_file(toml_path);
 
@@ -276,8 +297,13 @@ void Devices::from_toml(std::vector<std::unique_ptr<Device>> &devices,
                         auto d_table = device.as_table();
                         std::string name =
                             d_table->get("name")->value<std::string>().value();
+                        // Derived devices are not attached to a pin
                         unsigned int pin =
-                            d_table->get("pin")->value<unsigned int>().value();
+                            (modality == Modality::Derived)
+                                ? (*d_table)["pin"].value_or(0u)
+                                : d_table->get("pin")
+                                      ->value<unsigned int>()
+                                      .value();
                         auto &dev = devices.emplace_back(
                             std::make_unique<Device>(name, pin));
 
@@ -289,6 +315,9 @@ void Devices::from_toml(std::vector<std::unique_ptr<Device>> &devices,
                         case Modality::InOut:
                             dev->to_in_out();
                             break;
+                        case Modality::Derived:
+                            dev->to_derived();
+                            break;
                         }
 
                         // Handle type-specific fields
@@ -303,12 +332,18 @@ void Devices::from_toml(std::vector<std::unique_ptr<Device>> &devices,
                         case Type::Analog: {
                             std::optional<std::string> units =
                                 d_table->get("units")->value<std::string>();
-                            unsigned int abs_min = d_table->get("abs_min")
-                                                       ->value<unsigned int>()
-                                                       .value();
-                            unsigned int abs_max = d_table->get("abs_max")
-                                                       ->value<unsigned int>()
-                                                       .value();
+                            unsigned int abs_min =
+                                (modality == Modality::Derived)
+                                    ? (*d_table)["abs_min"].value_or(0u)
+                                    : d_table->get("abs_min")
+                                          ->value<unsigned int>()
+                                          .value();
+                            unsigned int abs_max =
+                                (modality == Modality::Derived)
+                                    ? (*d_table)["abs_max"].value_or(0u)
+                                    : d_table->get("abs_max")
+                                          ->value<unsigned int>()
+                                          .value();
                             float rel_min =
                                 d_table->get("rel_min")->value<float>().value();
                             float rel_max =
@@ -321,11 +356,19 @@ void Devices::from_toml(std::vector<std::unique_ptr<Device>> &devices,
                             break;
                         }
                         }
-                        dev->set_ui_thresholds();
+                        if (modality == Modality::Derived) {
+                            dev->expression = (*d_table)["expr"]
+                                                  .value<std::string>()
+                                                  .value();
+                        }
+                        dev->config_changed();
                     }
                 }
             }
         }
+
+        // Expressions can reference any device, so compile once all exist
+        Expressions::compile(devices);
     } catch (const toml::parse_error &err) {
         std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
     } catch (const std::out_of_range &err) {
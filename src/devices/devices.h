@@ -4,6 +4,9 @@
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
 #include <iomanip>
 #include <memory>
@@ -14,15 +17,10 @@
 #include <utility>
 #include <vector>
 
-// 3rd library headers
-// ---- ftxui ----
-#include <ftxui/component/component.hpp>
-
-inline std::string float_to_string(float value) {
-    std::stringstream stream;
-    stream << std::fixed << std::setprecision(2) << value;
-    return stream.str();
-}
+// Local headers
+#include "expr.h"
+#include "format.h"
+#include "graph.h"
 
 namespace Devices {
 
@@ -41,9 +39,10 @@ inline std::string type_to_string(Type type) {
     }
 }
 
-enum class Modality { In, InOut };
+enum class Modality { In, InOut, Derived };
 
-const std::array<Modality, 2> all_modalities = {Modality::In, Modality::InOut};
+const std::array<Modality, 3> all_modalities = {
+    Modality::In, Modality::InOut, Modality::Derived};
 
 inline std::string modality_to_string(Modality modality) {
     switch (modality) {
@@ -51,11 +50,42 @@ inline std::string modality_to_string(Modality modality) {
         return "In";
     case Modality::InOut:
         return "InOut";
+    case Modality::Derived:
+        return "Derived";
     default:
         return "Unknown";
     }
 }
 
+// Change generation shared by a set of devices. Writers bump it on every
+// change and publish once per batch, readers wait for it to move instead of
+// polling.
+class Changes {
+  public:
+    uint64_t generation() const { return _generation.load(); }
+    void bump() { _generation.fetch_add(1, std::memory_order_relaxed); }
+    // Wakes anyone waiting, call after a batch of bumps
+    void publish() {
+        {
+            // Pairs with the check in wait() so no wakeup is lost
+            const std::lock_guard<std::mutex> lg(_lock);
+        }
+        _changed.notify_all();
+    }
+    // Returns the generation once it differs from seen or timeout passes
+    uint64_t wait(uint64_t seen, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> ul(_lock);
+        _changed.wait_for(ul, timeout,
+                          [&] { return _generation.load() != seen; });
+        return _generation.load();
+    }
+
+  private:
+    std::atomic<uint64_t> _generation{0};
+    std::mutex _lock;
+    std::condition_variable _changed;
+};
+
 class Device {
 
   public:
@@ -78,14 +108,10 @@ class Device {
     std::vector<std::pair<float, float>> warnings;
     std::vector<std::pair<float, float>> cautions;
     std::vector<std::pair<float, float>> optimals;
-    // TUI elements
-    ftxui::GraphFunction ui_history;
-    ftxui::Decorator ui_thresholds;
-
-    Device(std::string name, unsigned int pin)
-        : name(name), pin(pin), ui_history([this](int width, int height) {
-              return this->get_value_transform(width, height);
-          }){};
+    // Optional fields for derived devices
+    std::optional<std::string> expression;
+    std::unique_ptr<Expressions::Program> program;
+    Device(std::string name, unsigned int pin) : name(name), pin(pin){};
 
     void clear_optionals() {
         is_active_low.reset();
@@ -98,15 +124,44 @@ class Device {
         warnings.clear();
         cautions.clear();
         optimals.clear();
+        expression.reset();
+        program.reset();
         _value_analog.store(0.0f);
         _value_digital.store(0);
+        config_changed();
     }
 
     std::string info() const;
 
-    void to_in() { modality = Modality::In; }
+    void to_in() {
+        modality = Modality::In;
+        config_changed();
+    }
+
+    void to_in_out() {
+        modality = Modality::InOut;
+        config_changed();
+    }
+
+    void to_derived() {
+        modality = Modality::Derived;
+        config_changed();
+    }
+
+    // Call after changing any of the public config fields directly, lets
+    // views cache what they build from them
+    void config_changed() { _config_generation++; }
+    uint64_t config_generation() const { return _config_generation; }
 
-    void to_in_out() { modality = Modality::InOut; }
+    // Report value and history changes to a shared generation as well
+    void watch(Changes *changes) { _changes = changes; }
+    // Bumped whenever the value or the history changes
+    uint64_t generation() const { return _generation.load(); }
+    uint64_t hist_generation() const { return _hist_generation.load(); }
+
+    // Driven devices only change when something writes to them
+    void drive() { _is_driven.store(true); }
+    bool is_driven() const { return _is_driven.load(); }
 
     void to_digital(bool is_active_low = false) {
         clear_optionals();
@@ -133,39 +188,89 @@ class Device {
         _value_analog.store(static_cast<float>(std::rand()) / RAND_MAX);
     }
 
-    ftxui::Component ui_detailed() const;
-    ftxui::Component ui_overview() const;
-    void set_ui_thresholds();
-
     // Const getters
     std::string get_name() const { return name; }
     float get_value_analog() const { return _value_analog.load(); }
     unsigned int get_value_digital() const { return _value_digital.load(); }
-    std::array<float, hist_size> get_value_analog_hist() const {
-        return _value_analog_hist;
+    // Oldest first
+    std::array<float, hist_size> get_value_analog_hist() const;
+    std::array<int, hist_size> get_value_digital_hist() const;
+    // Normalized value of the nth sample ever recorded, one of the last
+    // hist_size
+    float get_value_hist(uint64_t sample) const {
+        size_t slot = sample % hist_size;
+        return type == Type::Analog ? _value_analog_hist[slot]
+                                    : _value_digital_hist[slot];
+    }
+    // Value in relative units for analog devices, 1/0 for active/inactive
+    // digital devices
+    float get_value_scaled() const;
+    // The ring buffers themselves for bulk readers
+    const float *get_value_analog_ring() const {
+        return _value_analog_hist.data();
     }
-    std::array<int, hist_size> get_value_digital_hist() const {
-        return _value_digital_hist;
+    const int *get_value_digital_ring() const {
+        return _value_digital_hist.data();
     }
-    std::vector<int> get_value_transform(int width, int height) const;
+    // Cached graph columns, see Graph::Transform
+    const std::vector<Graph::Column> &get_value_transform(int width,
+                                                          int height) const {
+        return _transform.update(*this, width, height);
+    }
+    // Cached graph columns for comparison overlays, shared by every overlay
+    // the device is in so it's decimated once per frame
+    const std::vector<Graph::Column> &get_value_overlay(int width,
+                                                        int height) const {
+        return _overlay_transform.update(*this, width, height);
+    }
+    int get_overlay_samples() const { return _overlay_transform.samples(); }
+    // Cached braille sparkline, see Graph::Sparkline
+    const std::string &get_value_sparkline(int width) const {
+        return _sparkline.update(*this, width);
+    }
+    Graph::Mode get_graph_mode() const { return _transform.mode(); }
+    void set_graph_mode(Graph::Mode mode) { _transform.set_mode(mode); }
+    // Parts of the relative range outside every threshold range
+    std::vector<std::pair<float, float>> find_uncovered_intervals() const;
     bool is_warning(float value) const;
     bool is_caution(float value) const;
     bool is_optimal(float value) const;
 
     void update_value();
+    void set_value_scaled(float value);
     void record_value_to_hist();
+    // Appends one sample recorded elsewhere, normalized like the history
+    void append_hist(float analog, int digital);
+    // Mirrors values read elsewhere, normalized like the history
+    void set_values(float analog, int digital);
+    // Puts back a history saved from hist_generation() and both rings,
+    // before anything records or reads it
+    void restore_hist(uint64_t generation, const float *analog,
+                      const int *digital);
 
   private:
     // Modifiable values
     std::atomic<float> _value_analog;
     std::atomic<int> _value_digital;
+    std::atomic<bool> _is_driven{false};
+    std::atomic<uint64_t> _generation{0};
+    std::atomic<uint64_t> _hist_generation{0};
+    uint64_t _config_generation = 0;
+    Changes *_changes = nullptr;
+
+    void changed() {
+        _generation.fetch_add(1, std::memory_order_relaxed);
+        if (_changes != nullptr) {
+            _changes->bump();
+        }
+    }
 
-    // History of 100 values
+    // Ring buffers of the last hist_size values, sample n at n % hist_size
     std::array<float, hist_size> _value_analog_hist{0.0f};
     std::array<int, hist_size> _value_digital_hist{0};
-    std::vector<int> get_value_analog_transform(int width, int height) const;
-    std::vector<int> get_value_digital_transform(int width, int height) const;
-    std::vector<std::pair<float, float>> find_uncovered_intervals();
+    mutable Graph::Transform _transform;
+    mutable Graph::Transform _overlay_transform;
+    mutable Graph::Sparkline _sparkline;
 };
 
 void from_toml(std::vector<std::unique_ptr<Device>> &devices,
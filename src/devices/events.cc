@@ -0,0 +1,517 @@
+// std library headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// POSIX headers
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 3rd party headers
+// ---- tomlplusplus ----
+#include <toml++/toml.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "bytes.h"
+#include "devices.h"
+#include "events.h"
+#include "format.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "varint.h"
+
+using namespace Devices;
+using namespace Devices::Events;
+
+const char events_magic[4] = {'D', 'E', 'V', 'T'};
+const uint32_t events_version = 1;
+const size_t batch_header_bytes = 2 * sizeof(uint32_t) + sizeof(int64_t);
+// How often the writer moves events from the queue into the batch
+const std::chrono::milliseconds drain_interval{50};
+// A batch this big goes out without waiting for the flush interval
+const size_t max_batch_bytes = 64 * 1024;
+// Longest a failed write waits before the next try
+const std::chrono::milliseconds max_retry_delay{60 * 1000};
+
+std::atomic<Log *> installed{nullptr};
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+bool write_out(int fd, const std::string &data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+Log::Log(const Settings &settings,
+         const std::vector<std::unique_ptr<Device>> &devices)
+    : _settings(settings), _devices(devices),
+      _last_bits(devices.size(), 0) {
+    size_t capacity = 2;
+    while (capacity < _settings.capacity) {
+        capacity *= 2;
+    }
+    _cells = std::make_unique<Cell[]>(capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    _mask = capacity - 1;
+    _header_bytes = header().size();
+}
+
+Log::~Log() { stop(); }
+
+bool Log::start() {
+    // A file with only the names in it has nothing worth keeping
+    struct stat status;
+    if (::stat(_settings.path.c_str(), &status) == 0 &&
+        static_cast<size_t>(status.st_size) > _header_bytes) {
+        rotate();
+    } else {
+        open_file();
+    }
+    if (_fd < 0) {
+        return false;
+    }
+    const std::lock_guard<std::mutex> lg(_lock);
+    _running = true;
+    _writer = std::thread([this] { write_loop(); });
+    return true;
+}
+
+void Log::stop() {
+    {
+        const std::lock_guard<std::mutex> lg(_lock);
+        if (!_running) {
+            return;
+        }
+        _running = false;
+    }
+    _stopping.notify_all();
+    _writer.join();
+    ::close(_fd);
+    _fd = -1;
+}
+
+bool Log::push(Event &&event) {
+    size_t position = _enqueue.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &_cells[position & _mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        auto lag = static_cast<intptr_t>(sequence) -
+                   static_cast<intptr_t>(position);
+        if (lag == 0) {
+            // The cell is free, claim it unless another producer did first
+            if (_enqueue.compare_exchange_weak(position, position + 1,
+                                               std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // Still holding an event from a lap ago, the queue is full
+            _counters.dropped++;
+            return false;
+        } else {
+            position = _enqueue.load(std::memory_order_relaxed);
+        }
+    }
+    cell->event = std::move(event);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+// Only the writer pops, so its position needs no atomics
+bool Log::pop(Event &event) {
+    Cell &cell = _cells[_dequeue & _mask];
+    if (cell.sequence.load(std::memory_order_acquire) != _dequeue + 1) {
+        return false;
+    }
+    event = std::move(cell.event);
+    cell.sequence.store(_dequeue + _mask + 1, std::memory_order_release);
+    _dequeue++;
+    return true;
+}
+
+void Log::write_loop() {
+    TRACE_THREAD("events");
+    Event event;
+    auto next_write = std::chrono::steady_clock::now() +
+                      _settings.flush_interval;
+    std::unique_lock<std::mutex> ul(_lock);
+    while (true) {
+        bool running = _running;
+        ul.unlock();
+        bool full = false;
+        while (!(full = _batch.size() >= max_batch_bytes) && pop(event)) {
+            encode(event);
+        }
+        auto now = std::chrono::steady_clock::now();
+        bool wrote = false;
+        // Stopping gets one last try whatever the backoff
+        if (!running || ((full || now >= next_write) && now >= _retry_at)) {
+            TRACE_SPAN("write events");
+            next_write = now + _settings.flush_interval;
+            wrote = write_batch();
+            if (wrote) {
+                _retry_delay = std::chrono::milliseconds(0);
+                if (_file_bytes > _header_bytes &&
+                    (_file_bytes >= _settings.max_bytes ||
+                     now - _opened >= _settings.max_age)) {
+                    rotate();
+                }
+            } else {
+                // The batch is kept for the next try, meanwhile the queue
+                // fills up and drops rather than the producers waiting
+                std::cerr << "Failed to write event log " << _settings.path
+                          << ": " << std::strerror(errno) << std::endl;
+                _retry_delay = std::min(
+                    max_retry_delay,
+                    std::max(std::chrono::duration_cast<
+                                 std::chrono::milliseconds>(
+                                 _settings.flush_interval),
+                             2 * _retry_delay));
+                _retry_at = now + _retry_delay;
+            }
+        }
+        ul.lock();
+        if (!running) {
+            if (!wrote) {
+                _counters.dropped += _batch_events;
+                break;
+            }
+            if (!full) {
+                break;
+            }
+            // Everything pushed before stop() still goes out
+            continue;
+        }
+        if (full && wrote) {
+            // More is waiting, don't sleep on it
+            continue;
+        }
+        _stopping.wait_for(ul, drain_interval, [&] { return !_running; });
+    }
+}
+
+void Log::encode(const Event &event) {
+    if (event.kind != Kind::Config && event.device >= _last_bits.size()) {
+        return;
+    }
+    if (_batch_events == 0) {
+        _batch.assign(batch_header_bytes, '\0');
+        Bytes::put<int64_t>(_batch, 2 * sizeof(uint32_t), event.time_us);
+        _last_time_us = event.time_us;
+    }
+    _batch += static_cast<char>(event.kind);
+    _batch += static_cast<char>(event.detail);
+    Varint::put(_batch, Varint::zigzag(event.time_us - _last_time_us));
+    _last_time_us = event.time_us;
+    if (event.kind == Kind::Config) {
+        Varint::put(_batch, event.text.size());
+        _batch += event.text;
+    } else {
+        Varint::put(_batch, event.device);
+        uint32_t bits = Varint::float_bits(event.value);
+        uint32_t &last = _last_bits[event.device];
+        Varint::put(_batch, Varint::zigzag(static_cast<int64_t>(bits) -
+                                           static_cast<int64_t>(last)));
+        last = bits;
+    }
+    _batch_events++;
+    _counters.logged++;
+}
+
+// False leaves the batch as it was, and the file as it was before it
+bool Log::write_batch() {
+    if (_batch_events == 0) {
+        return true;
+    }
+    if (_fd < 0 && !open_file()) {
+        return false;
+    }
+    Bytes::put<uint32_t>(_batch, 0, _batch.size() - batch_header_bytes);
+    Bytes::put<uint32_t>(_batch, sizeof(uint32_t), _batch_events);
+    if (!write_out(_fd, _batch) || ::fdatasync(_fd) != 0) {
+        // Back to where the batch started. The batch only grows until it's
+        // written, so the retry covers whatever part of it made it.
+        int error = errno;
+        ::lseek(_fd, _file_bytes, SEEK_SET);
+        errno = error;
+        return false;
+    }
+    _file_bytes += _batch.size();
+    _counters.bytes += _batch.size();
+    _batch.clear();
+    _batch_events = 0;
+    return true;
+}
+
+std::string Log::header() const {
+    std::string header(events_magic, sizeof(events_magic));
+    Bytes::append<uint32_t>(header, events_version);
+    Bytes::append<uint32_t>(header, _devices.size());
+    for (const auto &device : _devices) {
+        size_t name_bytes = std::min<size_t>(device->name.size(),
+                                             UINT16_MAX);
+        Bytes::append<uint16_t>(header, name_bytes);
+        header.append(device->name.data(), name_bytes);
+    }
+    return header;
+}
+
+// Starts the file over with just the device names. Value deltas only start
+// over on rotate(), which happens between batches, so a batch encoded while
+// the file couldn't be opened still decodes.
+bool Log::open_file() {
+    _fd = ::open(_settings.path.c_str(),
+                 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        std::cerr << "Failed to open event log " << _settings.path << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    _opened = std::chrono::steady_clock::now();
+    _file_bytes = _header_bytes;
+    if (!write_out(_fd, header())) {
+        std::cerr << "Failed to write event log " << _settings.path << ": "
+                  << std::strerror(errno) << std::endl;
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Shifts path to path.1, path.1 to path.2 and so on, dropping the oldest
+void Log::rotate() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    for (int i = _settings.keep - 1; i >= 1; i--) {
+        std::string from = _settings.path + "." + std::to_string(i);
+        std::string to = _settings.path + "." + std::to_string(i + 1);
+        std::rename(from.c_str(), to.c_str());
+    }
+    if (_settings.keep > 0) {
+        std::rename(_settings.path.c_str(), (_settings.path + ".1").c_str());
+    }
+    _counters.rotations++;
+    std::fill(_last_bits.begin(), _last_bits.end(), 0);
+    open_file();
+}
+
+std::string Log::info() const {
+    std::ostringstream oss;
+    oss << "------------------------" << std::endl;
+    oss << "Event Log" << std::endl;
+    oss << "Logged: " << _counters.logged.load() << std::endl;
+    oss << "Dropped: " << _counters.dropped.load() << std::endl;
+    oss << "Written: " << _counters.bytes.load() / 1024 << " KB"
+        << std::endl;
+    oss << "Rotations: " << _counters.rotations.load() << std::endl;
+    oss << "------------------------" << std::endl;
+    return oss.str();
+}
+
+bool Events::read_file(const std::string &path,
+                       std::vector<std::string> &names,
+                       std::vector<Event> &events) {
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    size_t offset = sizeof(events_magic);
+    if (data.size() < offset + 2 * sizeof(uint32_t) ||
+        std::memcmp(data.data(), events_magic, sizeof(events_magic)) != 0 ||
+        Bytes::get<uint32_t>(data.data(), offset) != events_version) {
+        return false;
+    }
+    uint32_t count = Bytes::get<uint32_t>(data.data(), offset);
+    names.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset + sizeof(uint16_t) > data.size()) {
+            return false;
+        }
+        uint16_t name_bytes = Bytes::get<uint16_t>(data.data(), offset);
+        if (offset + name_bytes > data.size()) {
+            return false;
+        }
+        names.emplace_back(data.data() + offset, name_bytes);
+        offset += name_bytes;
+    }
+    std::vector<uint32_t> last_bits(count, 0);
+    while (offset + batch_header_bytes <= data.size()) {
+        uint32_t payload_bytes = Bytes::get<uint32_t>(data.data(), offset);
+        uint32_t batch_events = Bytes::get<uint32_t>(data.data(), offset);
+        int64_t time_us = Bytes::get<int64_t>(data.data(), offset);
+        size_t end = offset + payload_bytes;
+        if (end > data.size()) {
+            break;
+        }
+        for (uint32_t i = 0; i < batch_events; i++) {
+            Event event;
+            uint64_t delta, number;
+            if (offset + 2 > end) {
+                return true;
+            }
+            event.kind = static_cast<Kind>(data[offset++]);
+            event.detail = static_cast<uint8_t>(data[offset++]);
+            if (!Varint::get(data.data(), end, offset, delta)) {
+                return true;
+            }
+            time_us += Varint::unzigzag(delta);
+            event.time_us = time_us;
+            if (event.kind == Kind::Config) {
+                if (!Varint::get(data.data(), end, offset, number) ||
+                    number > end - offset) {
+                    return true;
+                }
+                event.text.assign(data.data() + offset, number);
+                offset += number;
+            } else {
+                if (!Varint::get(data.data(), end, offset, number) ||
+                    number >= count ||
+                    !Varint::get(data.data(), end, offset, delta)) {
+                    return true;
+                }
+                event.device = number;
+                uint32_t &last = last_bits[number];
+                last = static_cast<uint32_t>(last + Varint::unzigzag(delta));
+                event.value = Varint::bits_float(last);
+            }
+            events.push_back(std::move(event));
+        }
+        offset = end;
+    }
+    return true;
+}
+
+std::string Events::to_string(const Event &event,
+                              const std::vector<std::string> &names) {
+    std::time_t seconds = event.time_us / 1000000;
+    std::tm local;
+    localtime_r(&seconds, &local);
+    char stamp[32];
+    size_t size = std::strftime(stamp, sizeof(stamp), "%F %T", &local);
+    std::snprintf(stamp + size, sizeof(stamp) - size, ".%03d",
+                  static_cast<int>(event.time_us / 1000 % 1000));
+    std::string line = stamp;
+    line += " ";
+    line += kind_to_string(event.kind);
+    line += " ";
+    if (event.kind == Kind::Config) {
+        line += event.detail == 0 ? "loaded " : "failed ";
+        line += event.text;
+        return line;
+    }
+    line += event.device < names.size() ? names[event.device] : "?";
+    line += " ";
+    if (event.kind == Kind::Alarm) {
+        line += Pipeline::level_to_string(
+            static_cast<Pipeline::Level>(event.detail));
+        line += " at ";
+        line += float_to_string(event.value);
+    } else {
+        line += float_to_string(event.value);
+        line += " from ";
+        line += Actuators::source_to_string(
+            static_cast<Actuators::Source>(event.detail));
+    }
+    return line;
+}
+
+void Events::install(Log *log) { installed.store(log); }
+
+bool Events::enabled() {
+    return installed.load(std::memory_order_relaxed) != nullptr;
+}
+
+// Device events carry no text, so building one doesn't allocate
+void push_device_event(Kind kind, uint8_t detail, size_t device,
+                       float value) {
+    Log *log = installed.load(std::memory_order_acquire);
+    if (log == nullptr) {
+        return;
+    }
+    Event event;
+    event.kind = kind;
+    event.detail = detail;
+    event.device = device;
+    event.value = value;
+    event.time_us = now_us();
+    log->push(std::move(event));
+}
+
+void Events::alarm(size_t device, Pipeline::Level level, float value) {
+    push_device_event(Kind::Alarm, static_cast<uint8_t>(level), device,
+                      value);
+}
+
+void Events::command(size_t device, float value, Actuators::Source source) {
+    push_device_event(Kind::Command, static_cast<uint8_t>(source), device,
+                      value);
+}
+
+void Events::write(size_t device, float value, Actuators::Source source) {
+    push_device_event(Kind::Write, static_cast<uint8_t>(source), device,
+                      value);
+}
+
+void Events::config(const std::string &path, const std::string &error) {
+    Log *log = installed.load(std::memory_order_acquire);
+    if (log == nullptr) {
+        return;
+    }
+    Event event;
+    event.kind = Kind::Config;
+    event.detail = error.empty() ? 0 : 1;
+    event.time_us = now_us();
+    event.text = error.empty() ? path : path + ": " + error;
+    log->push(std::move(event));
+}
+
+void Events::from_toml(Settings &settings, const std::string &toml_path) {
+    try {
+        auto config = toml::parse_file(toml_path);
+        settings.path = config["Events"]["path"].value_or<std::string>("");
+        settings.max_bytes = config["Events"]["max_kb"].value_or<int64_t>(
+                                 settings.max_bytes / 1024) *
+                             1024;
+        settings.max_age = std::chrono::seconds(
+            config["Events"]["max_age_s"].value_or<int64_t>(
+                settings.max_age.count()));
+        settings.keep = config["Events"]["keep"].value_or(settings.keep);
+        settings.capacity = config["Events"]["capacity"].value_or<int64_t>(
+            settings.capacity);
+        settings.flush_interval = std::chrono::milliseconds(
+            config["Events"]["flush_ms"].value_or<int64_t>(
+                settings.flush_interval.count()));
+    } catch (const toml::parse_error &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+    }
+}
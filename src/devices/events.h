@@ -0,0 +1,177 @@
+#pragma once
+
+// std library headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "pipeline.h"
+
+namespace Devices {
+
+namespace Events {
+
+enum class Kind : uint8_t { Alarm = 1, Command = 2, Write = 3, Config = 4 };
+
+inline const char *kind_to_string(Kind kind) {
+    switch (kind) {
+    case Kind::Alarm:
+        return "alarm";
+    case Kind::Command:
+        return "command";
+    case Kind::Write:
+        return "write";
+    case Kind::Config:
+        return "config";
+    default:
+        return "unknown";
+    }
+}
+
+struct Event {
+    Kind kind = Kind::Config;
+    // Pipeline::Level for alarms, Actuators::Source for commands and writes,
+    // 1 for a config that failed to load
+    uint8_t detail = 0;
+    uint32_t device = 0;
+    float value = 0.0f;
+    // Wall clock microseconds
+    int64_t time_us = 0;
+    // Only config events have text, the others never allocate
+    std::string text;
+};
+
+struct Settings {
+    // Empty to disable the log
+    std::string path;
+    // The current file is rotated past either of these
+    size_t max_bytes = 1024 * 1024;
+    std::chrono::seconds max_age{24 * 60 * 60};
+    // Rotated files kept as path.1, path.2, ...
+    int keep = 4;
+    // Events that can wait for the writer, more are dropped
+    size_t capacity = 16384;
+    // How often batches are written out
+    std::chrono::milliseconds flush_interval{1000};
+};
+
+struct Counters {
+    std::atomic<uint64_t> logged{0};
+    // Pushed while the queue was full
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> rotations{0};
+};
+
+// Structured binary log of alarm transitions, actuator commands and writes,
+// and config loads. Any thread pushes into a bounded lock-free queue
+// (Vyukov's), which drops rather than waits when full, so a slow card never
+// holds up sampling or rendering. One writer thread drains it, batches and
+// writes. A failed write keeps its batch and is retried with backoff, and
+// files are only rotated once they hold events.
+//
+// Each file starts with [magic][u32 version][u32 count] and the device
+// names, each [u16 length][name], so it reads back without the config. Then
+// come batches of [u32 payload bytes][u32 events][i64 first time][payload]
+// in host byte order. In the payload every event is [u8 kind][u8 detail]
+// [varint time delta], followed by [varint device][varint value delta] for
+// device events or [varint length][text] for config ones. Time deltas are
+// from the previous event, value deltas are of the float bits from the
+// device's previous event in the file, both zigzag encoded.
+class Log {
+  public:
+    Log(const Settings &settings,
+        const std::vector<std::unique_ptr<Device>> &devices);
+    ~Log();
+
+    // Rotates away whatever an earlier run left and starts the writer
+    bool start();
+    // Writes out everything pushed so far and joins the writer
+    void stop();
+
+    // Never blocks, false if the event was dropped
+    bool push(Event &&event);
+
+    const Counters &counters() const { return _counters; }
+    std::string info() const;
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Event event;
+    };
+
+    Settings _settings;
+    const std::vector<std::unique_ptr<Device>> &_devices;
+    Counters _counters;
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask = 0;
+    // Producers only contend on this, the writer keeps its own position
+    alignas(64) std::atomic<size_t> _enqueue{0};
+    alignas(64) size_t _dequeue = 0;
+
+    int _fd = -1;
+    size_t _file_bytes = 0;
+    size_t _header_bytes = 0;
+    std::chrono::steady_clock::time_point _opened;
+    // Float bits of each device's last value in the current file
+    std::vector<uint32_t> _last_bits;
+    std::string _batch;
+    uint32_t _batch_events = 0;
+    int64_t _last_time_us = 0;
+    // Backoff after a failed write
+    std::chrono::milliseconds _retry_delay{0};
+    std::chrono::steady_clock::time_point _retry_at;
+
+    bool _running = false;
+    std::thread _writer;
+    std::mutex _lock;
+    std::condition_variable _stopping;
+
+    bool pop(Event &event);
+    void write_loop();
+    void encode(const Event &event);
+    bool write_batch();
+    std::string header() const;
+    bool open_file();
+    void rotate();
+};
+
+// Reads a log file back, up to a torn or corrupt batch at the end. False if
+// it isn't an event log at all.
+bool read_file(const std::string &path, std::vector<std::string> &names,
+               std::vector<Event> &events);
+
+// One readable line per event
+std::string to_string(const Event &event,
+                      const std::vector<std::string> &names);
+
+// The log the functions below push to, none until one is installed. Uninstall
+// with nullptr before the log is stopped, and only once nothing that could
+// push is left running.
+void install(Log *log);
+// Whether an installed log would take events, for skipping the work of
+// finding them
+bool enabled();
+
+void alarm(size_t device, Pipeline::Level level, float value);
+void command(size_t device, float value, Actuators::Source source);
+void write(size_t device, float value, Actuators::Source source);
+// A config file loaded, error empty when it parsed
+void config(const std::string &path, const std::string &error);
+
+void from_toml(Settings &settings, const std::string &toml_path);
+
+} // namespace Events
+
+} // namespace Devices
@@ -0,0 +1,597 @@
+// std library headers
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Local headers
+#include "devices.h"
+#include "expr.h"
+
+using namespace Devices;
+using namespace Devices::Expressions;
+
+namespace Devices {
+
+namespace Expressions {
+
+// Recursive descent parser emitting reverse polish bytecode. Precedence from
+// lowest to highest: ||, &&, == !=, < <= > >=, + -, * /, unary - !, ^
+class Parser {
+  public:
+    Parser(const std::string &source,
+           const std::vector<std::unique_ptr<Device>> &devices,
+           Program &program)
+        : _source(source), _devices(devices), _program(program) {}
+
+    bool parse(std::string &error) {
+        if (!parse_or()) {
+            error = _error;
+            return false;
+        }
+        skip_spaces();
+        if (_pos != _source.size()) {
+            error = "unexpected '" + std::string(1, _source[_pos]) +
+                    "' at column " + std::to_string(_pos + 1);
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    const std::string &_source;
+    const std::vector<std::unique_ptr<Device>> &_devices;
+    Program &_program;
+    size_t _pos = 0;
+    size_t _depth = 0;
+    std::string _error;
+
+    bool fail(const std::string &message) {
+        if (_error.empty()) {
+            _error = message + " at column " + std::to_string(_pos + 1);
+        }
+        return false;
+    }
+
+    void skip_spaces() {
+        while (_pos < _source.size() &&
+               std::isspace(static_cast<unsigned char>(_source[_pos]))) {
+            _pos++;
+        }
+    }
+
+    bool accept(const char *token) {
+        skip_spaces();
+        size_t length = std::char_traits<char>::length(token);
+        if (_source.compare(_pos, length, token) == 0) {
+            _pos += length;
+            return true;
+        }
+        return false;
+    }
+
+    // Pushes and pops are tracked to size the evaluation stack up front
+    void emit(Op op, int pops, int pushes, float constant = 0.0f,
+              uint32_t device = 0) {
+        _program._code.push_back({op, constant, device});
+        _depth = _depth - pops + pushes;
+        _program._stack_depth = std::max(_program._stack_depth, _depth);
+    }
+
+    bool parse_or() {
+        if (!parse_and()) {
+            return false;
+        }
+        while (accept("||")) {
+            if (!parse_and()) {
+                return false;
+            }
+            emit(Op::Or, 2, 1);
+        }
+        return true;
+    }
+
+    bool parse_and() {
+        if (!parse_equality()) {
+            return false;
+        }
+        while (accept("&&")) {
+            if (!parse_equality()) {
+                return false;
+            }
+            emit(Op::And, 2, 1);
+        }
+        return true;
+    }
+
+    bool parse_equality() {
+        if (!parse_relational()) {
+            return false;
+        }
+        while (true) {
+            Op op;
+            if (accept("==")) {
+                op = Op::Eq;
+            } else if (accept("!=")) {
+                op = Op::Ne;
+            } else {
+                return true;
+            }
+            if (!parse_relational()) {
+                return false;
+            }
+            emit(op, 2, 1);
+        }
+    }
+
+    bool parse_relational() {
+        if (!parse_additive()) {
+            return false;
+        }
+        while (true) {
+            Op op;
+            if (accept("<=")) {
+                op = Op::Le;
+            } else if (accept(">=")) {
+                op = Op::Ge;
+            } else if (accept("<")) {
+                op = Op::Lt;
+            } else if (accept(">")) {
+                op = Op::Gt;
+            } else {
+                return true;
+            }
+            if (!parse_additive()) {
+                return false;
+            }
+            emit(op, 2, 1);
+        }
+    }
+
+    bool parse_additive() {
+        if (!parse_multiplicative()) {
+            return false;
+        }
+        while (true) {
+            Op op;
+            if (accept("+")) {
+                op = Op::Add;
+            } else if (accept("-")) {
+                op = Op::Sub;
+            } else {
+                return true;
+            }
+            if (!parse_multiplicative()) {
+                return false;
+            }
+            emit(op, 2, 1);
+        }
+    }
+
+    bool parse_multiplicative() {
+        if (!parse_unary()) {
+            return false;
+        }
+        while (true) {
+            Op op;
+            if (accept("*")) {
+                op = Op::Mul;
+            } else if (accept("/")) {
+                op = Op::Div;
+            } else {
+                return true;
+            }
+            if (!parse_unary()) {
+                return false;
+            }
+            emit(op, 2, 1);
+        }
+    }
+
+    bool parse_unary() {
+        if (accept("-")) {
+            if (!parse_unary()) {
+                return false;
+            }
+            emit(Op::Neg, 1, 1);
+            return true;
+        }
+        // Don't swallow the first character of "!="
+        skip_spaces();
+        if (_source.compare(_pos, 1, "!") == 0 &&
+            _source.compare(_pos, 2, "!=") != 0) {
+            _pos++;
+            if (!parse_unary()) {
+                return false;
+            }
+            emit(Op::Not, 1, 1);
+            return true;
+        }
+        return parse_power();
+    }
+
+    bool parse_power() {
+        if (!parse_primary()) {
+            return false;
+        }
+        if (accept("^")) {
+            // Right associative, and binds tighter than unary minus on its
+            // left but not on its right: -2^2 == -4, 2^-1 == 0.5
+            if (!parse_unary()) {
+                return false;
+            }
+            emit(Op::Pow, 2, 1);
+        }
+        return true;
+    }
+
+    bool parse_primary() {
+        skip_spaces();
+        if (_pos >= _source.size()) {
+            return fail("unexpected end of expression");
+        }
+        char c = _source[_pos];
+        if (c == '(') {
+            _pos++;
+            if (!parse_or()) {
+                return false;
+            }
+            return accept(")") || fail("expected ')'");
+        }
+        if (c == '{') {
+            return parse_reference();
+        }
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            return parse_number();
+        }
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            return parse_call();
+        }
+        return fail("unexpected '" + std::string(1, c) + "'");
+    }
+
+    bool parse_number() {
+        const char *begin = _source.c_str() + _pos;
+        char *end = nullptr;
+        float value = std::strtof(begin, &end);
+        if (end == begin) {
+            return fail("invalid number");
+        }
+        _pos += end - begin;
+        emit(Op::Const, 0, 1, value);
+        return true;
+    }
+
+    bool parse_reference() {
+        size_t close = _source.find('}', _pos);
+        if (close == std::string::npos) {
+            return fail("expected '}'");
+        }
+        std::string name = _source.substr(_pos + 1, close - _pos - 1);
+        auto it = std::find_if(
+            _devices.begin(), _devices.end(),
+            [&name](const auto &device) { return device->name == name; });
+        if (it == _devices.end()) {
+            return fail("unknown device '" + name + "'");
+        }
+        uint32_t index = static_cast<uint32_t>(it - _devices.begin());
+        _pos = close + 1;
+        auto &inputs = _program._inputs;
+        if (std::find(inputs.begin(), inputs.end(), index) == inputs.end()) {
+            inputs.push_back(index);
+        }
+        emit(Op::Input, 0, 1, 0.0f, index);
+        return true;
+    }
+
+    bool parse_call() {
+        size_t start = _pos;
+        while (_pos < _source.size() &&
+               std::isalnum(static_cast<unsigned char>(_source[_pos]))) {
+            _pos++;
+        }
+        std::string function = _source.substr(start, _pos - start);
+
+        struct Builtin {
+            const char *name;
+            Op op;
+            int arity;
+        };
+        static const Builtin builtins[] = {
+            {"abs", Op::Abs, 1},   {"sqrt", Op::Sqrt, 1},
+            {"exp", Op::Exp, 1},   {"log", Op::Log, 1},
+            {"min", Op::Min, 2},   {"max", Op::Max, 2},
+            {"clamp", Op::Clamp, 3}, {"if", Op::Select, 3},
+        };
+        const Builtin *builtin = nullptr;
+        for (const auto &candidate : builtins) {
+            if (function == candidate.name) {
+                builtin = &candidate;
+                break;
+            }
+        }
+        if (builtin == nullptr) {
+            _pos = start;
+            return fail("unknown function '" + function + "'");
+        }
+        if (!accept("(")) {
+            return fail("expected '('");
+        }
+        for (int i = 0; i < builtin->arity; i++) {
+            if (i > 0 && !accept(",")) {
+                return fail("expected ','");
+            }
+            if (!parse_or()) {
+                return false;
+            }
+        }
+        if (!accept(")")) {
+            return fail("expected ')'");
+        }
+        emit(builtin->op, builtin->arity, 1);
+        return true;
+    }
+};
+
+} // namespace Expressions
+
+} // namespace Devices
+
+std::unique_ptr<Program>
+Program::compile(const std::string &source,
+                 const std::vector<std::unique_ptr<Device>> &devices,
+                 std::string &error) {
+    auto program = std::make_unique<Program>();
+    Parser parser(source, devices, *program);
+    if (!parser.parse(error)) {
+        return nullptr;
+    }
+    return program;
+}
+
+float Program::evaluate(const float *inputs, float *stack) const {
+    float *top = stack - 1;
+    for (const auto &instruction : _code) {
+        switch (instruction.op) {
+        case Op::Const:
+            *++top = instruction.constant;
+            break;
+        case Op::Input:
+            *++top = inputs[instruction.device];
+            break;
+        case Op::Neg:
+            *top = -*top;
+            break;
+        case Op::Not:
+            *top = (*top == 0.0f) ? 1.0f : 0.0f;
+            break;
+        case Op::Abs:
+            *top = std::fabs(*top);
+            break;
+        case Op::Sqrt:
+            *top = std::sqrt(*top);
+            break;
+        case Op::Exp:
+            *top = std::exp(*top);
+            break;
+        case Op::Log:
+            *top = std::log(*top);
+            break;
+        case Op::Clamp:
+            top -= 2;
+            *top = std::min(std::max(top[0], top[1]), top[2]);
+            break;
+        case Op::Select:
+            top -= 2;
+            *top = (top[0] != 0.0f) ? top[1] : top[2];
+            break;
+        default: {
+            // Binary operators
+            float rhs = *top--;
+            float lhs = *top;
+            switch (instruction.op) {
+            case Op::Add:
+                *top = lhs + rhs;
+                break;
+            case Op::Sub:
+                *top = lhs - rhs;
+                break;
+            case Op::Mul:
+                *top = lhs * rhs;
+                break;
+            case Op::Div:
+                *top = lhs / rhs;
+                break;
+            case Op::Pow:
+                *top = std::pow(lhs, rhs);
+                break;
+            case Op::Lt:
+                *top = lhs < rhs;
+                break;
+            case Op::Le:
+                *top = lhs <= rhs;
+                break;
+            case Op::Gt:
+                *top = lhs > rhs;
+                break;
+            case Op::Ge:
+                *top = lhs >= rhs;
+                break;
+            case Op::Eq:
+                *top = lhs == rhs;
+                break;
+            case Op::Ne:
+                *top = lhs != rhs;
+                break;
+            case Op::And:
+                *top = (lhs != 0.0f) && (rhs != 0.0f);
+                break;
+            case Op::Or:
+                *top = (lhs != 0.0f) || (rhs != 0.0f);
+                break;
+            case Op::Min:
+                *top = std::min(lhs, rhs);
+                break;
+            case Op::Max:
+                *top = std::max(lhs, rhs);
+                break;
+            default:
+                break;
+            }
+            break;
+        }
+        }
+    }
+    return *top;
+}
+
+// Kahn's algorithm over derived devices, returns false on a dependency cycle
+// leaving the devices that could not be ordered out of order
+static bool
+topological_order(const std::vector<std::unique_ptr<Device>> &devices,
+                  std::vector<uint32_t> &order) {
+    std::vector<uint32_t> pending(devices.size(), 0);
+    std::vector<std::vector<uint32_t>> dependents(devices.size());
+    size_t derived = 0;
+    for (uint32_t i = 0; i < devices.size(); i++) {
+        if (!devices[i]->program) {
+            continue;
+        }
+        derived++;
+        for (auto input : devices[i]->program->inputs()) {
+            if (devices[input]->program) {
+                pending[i]++;
+                dependents[input].push_back(i);
+            }
+        }
+    }
+    order.clear();
+    for (uint32_t i = 0; i < devices.size(); i++) {
+        if (devices[i]->program && pending[i] == 0) {
+            order.push_back(i);
+        }
+    }
+    for (size_t head = 0; head < order.size(); head++) {
+        for (auto dependent : dependents[order[head]]) {
+            if (--pending[dependent] == 0) {
+                order.push_back(dependent);
+            }
+        }
+    }
+    return order.size() == derived;
+}
+
+void Expressions::compile(std::vector<std::unique_ptr<Device>> &devices) {
+    for (auto &device : devices) {
+        if (!device->expression.has_value()) {
+            continue;
+        }
+        std::string error;
+        device->program =
+            Program::compile(device->expression.value(), devices, error);
+        if (!device->program) {
+            std::cerr << "Failed to compile expression for " << device->name
+                      << ": " << error << std::endl;
+        }
+    }
+    std::vector<uint32_t> order;
+    if (!topological_order(devices, order)) {
+        std::vector<uint8_t> ordered(devices.size(), 0);
+        for (auto index : order) {
+            ordered[index] = 1;
+        }
+        for (uint32_t i = 0; i < devices.size(); i++) {
+            if (devices[i]->program && !ordered[i]) {
+                std::cerr << "Failed to compile expression for "
+                          << devices[i]->name << ": dependency cycle"
+                          << std::endl;
+                devices[i]->program.reset();
+            }
+        }
+    }
+}
+
+Engine::Engine(const std::vector<std::unique_ptr<Device>> &devices)
+    : _devices(devices), _values(devices.size(), 0.0f) {
+    topological_order(devices, _order);
+    _dirty.assign(_order.size(), 1);
+
+    // Map device index to its position in the evaluation order
+    std::vector<uint32_t> position(devices.size(), 0);
+    for (uint32_t i = 0; i < _order.size(); i++) {
+        position[_order[i]] = i;
+    }
+
+    // Build the dependents table and collect non-derived inputs
+    std::vector<uint32_t> counts(devices.size(), 0);
+    std::vector<uint8_t> is_source(devices.size(), 0);
+    size_t stack_depth = 0;
+    for (auto index : _order) {
+        const auto &program = *devices[index]->program;
+        stack_depth = std::max(stack_depth, program.stack_depth());
+        for (auto input : program.inputs()) {
+            counts[input]++;
+            if (!devices[input]->program) {
+                is_source[input] = 1;
+            }
+        }
+    }
+    _dependents_offsets.assign(devices.size() + 1, 0);
+    for (size_t i = 0; i < devices.size(); i++) {
+        _dependents_offsets[i + 1] = _dependents_offsets[i] + counts[i];
+        if (is_source[i]) {
+            _sources.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    _dependents.resize(_dependents_offsets.back());
+    std::vector<uint32_t> fill(_dependents_offsets.begin(),
+                               _dependents_offsets.end() - 1);
+    for (auto index : _order) {
+        for (auto input : devices[index]->program->inputs()) {
+            _dependents[fill[input]++] = position[index];
+        }
+    }
+    _stack.resize(std::max<size_t>(stack_depth, 1));
+
+    for (auto source : _sources) {
+        _values[source] = devices[source]->get_value_scaled();
+    }
+}
+
+void Engine::mark_dependents(uint32_t device) {
+    for (uint32_t i = _dependents_offsets[device];
+         i < _dependents_offsets[device + 1]; i++) {
+        _dirty[_dependents[i]] = 1;
+    }
+}
+
+void Engine::update() {
+    for (auto source : _sources) {
+        float value = _devices[source]->get_value_scaled();
+        if (value != _values[source]) {
+            _values[source] = value;
+            mark_dependents(source);
+        }
+    }
+    // Dependents always come later in the order, so a single pass suffices
+    for (uint32_t i = 0; i < _order.size(); i++) {
+        if (!_dirty[i]) {
+            continue;
+        }
+        _dirty[i] = 0;
+        uint32_t index = _order[i];
+        auto &device = *_devices[index];
+        device.set_value_scaled(
+            device.program->evaluate(_values.data(), _stack.data()));
+        // Dependents see the value as stored, clamped to the device's range
+        float value = device.get_value_scaled();
+        if (value != _values[index]) {
+            _values[index] = value;
+            mark_dependents(index);
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// std library headers
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Devices {
+
+class Device;
+
+namespace Expressions {
+
+// Stack machine opcodes, evaluated in reverse polish order
+enum class Op : uint8_t {
+    Const,
+    Input,
+    Neg,
+    Not,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Pow,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Eq,
+    Ne,
+    And,
+    Or,
+    Abs,
+    Sqrt,
+    Exp,
+    Log,
+    Min,
+    Max,
+    Clamp,
+    Select
+};
+
+struct Instruction {
+    Op op;
+    // Constant value for Op::Const, device index for Op::Input
+    float constant;
+    uint32_t device;
+};
+
+// An expression compiled once into flat bytecode. References to other devices
+// are written as {device-name} and resolved to indices into the device list,
+// e.g. "{moisture-0} < 30" or "max({temperature-0} - 32, 0) / 1.8".
+class Program {
+  public:
+    // Returns nullptr and fills error if the source can't be compiled
+    static std::unique_ptr<Program>
+    compile(const std::string &source,
+            const std::vector<std::unique_ptr<Device>> &devices,
+            std::string &error);
+
+    // Inputs are scaled device values indexed by device index, stack must
+    // hold at least stack_depth() floats
+    float evaluate(const float *inputs, float *stack) const;
+
+    const std::vector<uint32_t> &inputs() const { return _inputs; }
+    size_t stack_depth() const { return _stack_depth; }
+
+  private:
+    std::vector<Instruction> _code;
+    // Unique device indices referenced by the program
+    std::vector<uint32_t> _inputs;
+    size_t _stack_depth = 0;
+
+    friend class Parser;
+};
+
+// Compiles the expression of every derived device, dropping (and reporting)
+// the ones that fail to parse or take part in a dependency cycle
+void compile(std::vector<std::unique_ptr<Device>> &devices);
+
+// Evaluates derived devices in dependency order, only re-evaluating the ones
+// whose inputs changed since the last update
+class Engine {
+  public:
+    explicit Engine(const std::vector<std::unique_ptr<Device>> &devices);
+
+    void update();
+    size_t size() const { return _order.size(); }
+
+  private:
+    const std::vector<std::unique_ptr<Device>> &_devices;
+
+    // Derived device indices in topological order
+    std::vector<uint32_t> _order;
+    std::vector<uint8_t> _dirty;
+    // Non-derived devices referenced by at least one program
+    std::vector<uint32_t> _sources;
+    // Dependents of each device as positions in _order (CSR layout)
+    std::vector<uint32_t> _dependents_offsets;
+    std::vector<uint32_t> _dependents;
+    // Last seen scaled value per device
+    std::vector<float> _values;
+    std::vector<float> _stack;
+
+    void mark_dependents(uint32_t device);
+};
+
+} // namespace Expressions
+
+} // namespace Devices
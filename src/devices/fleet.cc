@@ -0,0 +1,82 @@
+// std library headers
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+// Local headers
+#include "fleet.h"
+#include "format.h"
+
+using namespace Devices;
+using namespace Devices::Fleet;
+
+struct Kind {
+    const char *name;
+    const char *units;
+    float rel_min;
+    float rel_max;
+};
+
+const Kind analog_kinds[] = {{"moisture", "Percent,%", 0.0f, 100.0f},
+                             {"battery", "Volts,V", 0.0f, 24.0f},
+                             {"temperature", "Fahrenheit,F", -20.0f, 135.0f}};
+const char *digital_in_kinds[] = {"depth-sensor", "float-switch"};
+const char *digital_in_out_kinds[] = {"pump-switch", "valve"};
+const char *threshold_tables[] = {"Warnings", "Cautions", "Optimals"};
+
+// Whether item i is one of the first share of every run, spreads a share
+// evenly over a sequence without randomness
+bool pick(size_t i, double share) {
+    return std::floor((i + 1) * share) > std::floor(i * share);
+}
+
+std::string Fleet::to_toml(const Spec &spec) {
+    std::ostringstream oss;
+    oss << "[Devices]\n";
+    oss << "description = \"Generated fleet of " << spec.devices
+        << " devices.\"\n";
+    int zones = std::max(spec.zones, 1);
+    size_t analog = 0;
+    size_t digital = 0;
+    for (size_t pin = 0; pin < spec.devices; pin++) {
+        std::string zone = "zone-" + std::to_string(pin % zones) + "-";
+        oss << "\n";
+        if (pick(pin, spec.analog)) {
+            const Kind &kind = analog_kinds[analog % 3];
+            std::string modality = pick(analog, spec.in_out) ? "InOut" : "In";
+            std::string table = "Devices.Analog." + modality;
+            oss << "[[" << table << "]]\n"
+                << "name = \"" << zone << kind.name << "-" << analog << "\"\n"
+                << "pin = " << pin << "\n"
+                << "units = \"" << kind.units << "\"\n"
+                << "abs_min = 0\n"
+                << "abs_max = 65535\n"
+                << "rel_min = " << float_to_string(kind.rel_min) << "\n"
+                << "rel_max = " << float_to_string(kind.rel_max) << "\n";
+            float step = (kind.rel_max - kind.rel_min) /
+                         std::max(spec.thresholds, 1);
+            for (int t = 0; t < spec.thresholds; t++) {
+                oss << "[[" << table << "." << threshold_tables[t % 3]
+                    << "]]\n"
+                    << "min = " << float_to_string(kind.rel_min + t * step)
+                    << "\n"
+                    << "max = "
+                    << float_to_string(kind.rel_min + (t + 1) * step) << "\n";
+            }
+            analog++;
+        } else {
+            bool in_out = pick(digital, spec.in_out);
+            const char *kind = in_out ? digital_in_out_kinds[digital % 2]
+                                      : digital_in_kinds[digital % 2];
+            oss << "[[Devices.Digital." << (in_out ? "InOut" : "In") << "]]\n"
+                << "name = \"" << zone << kind << "-" << digital << "\"\n"
+                << "pin = " << pin << "\n"
+                << "is_active_low = " << (digital % 2 ? "true" : "false")
+                << "\n";
+            digital++;
+        }
+    }
+    return oss.str();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// std library headers
+#include <cstddef>
+#include <string>
+
+namespace Devices {
+
+namespace Fleet {
+
+// Shape of a generated device config
+struct Spec {
+    size_t devices = 100;
+    // Share of all devices that are analog, the rest are digital
+    double analog = 0.6;
+    // Share of each type that are InOut, the rest are In
+    double in_out = 0.2;
+    // Threshold ranges on each analog device, cycling through warning,
+    // caution and optimal
+    int thresholds = 3;
+    // Devices are dealt round robin into zones and named after them
+    int zones = 1;
+};
+
+// A config in the same format as test_files/device_config.toml. The same
+// spec always gives the same config.
+std::string to_toml(const Spec &spec);
+
+} // namespace Fleet
+
+} // namespace Devices
@@ -0,0 +1,52 @@
+#pragma once
+
+// std library headers
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <system_error>
+
+namespace Devices {
+
+// Enough for any float with two decimals, sign included
+constexpr size_t float_chars_max = 48;
+
+// Writes the value with two decimals, same as std::fixed with
+// std::setprecision(2), and returns the number of chars written. Never
+// allocates.
+inline size_t format_float(float value, char *buffer, size_t size) {
+    auto [end, ec] = std::to_chars(buffer, buffer + size, value,
+                                   std::chars_format::fixed, 2);
+    if (ec != std::errc()) {
+        return 0;
+    }
+    return end - buffer;
+}
+
+// Formatted text of the last value seen, an unchanged value costs one
+// comparison and a changed one reuses the string's storage
+class FloatMemo {
+  public:
+    const std::string &operator()(float value) {
+        if (!_valid || value != _value) {
+            char buffer[float_chars_max];
+            _text.assign(buffer, format_float(value, buffer, sizeof(buffer)));
+            _value = value;
+            _valid = true;
+        }
+        return _text;
+    }
+
+  private:
+    float _value = 0.0f;
+    bool _valid = false;
+    std::string _text;
+};
+
+} // namespace Devices
+
+inline std::string float_to_string(float value) {
+    char buffer[Devices::float_chars_max];
+    return std::string(buffer,
+                       Devices::format_float(value, buffer, sizeof(buffer)));
+}
@@ -0,0 +1,226 @@
+// std library headers
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Local headers
+#include "devices.h"
+#include "graph.h"
+
+using namespace Devices;
+using namespace Devices::Graph;
+
+// Calls f(values, count) for samples [first, last), at most two runs since
+// the ring wraps once
+template <typename T, typename F>
+void for_each_run(const T *ring, int64_t first, int64_t last, F f) {
+    while (first < last) {
+        int64_t slot = first % Device::hist_size;
+        int64_t count = std::min<int64_t>(last - first,
+                                          Device::hist_size - slot);
+        f(ring + slot, count);
+        first += count;
+    }
+}
+
+// Branch free so the compiler vectorizes them
+template <typename T>
+void min_max(const T *values, int64_t count, float &low, float &high) {
+    for (int64_t i = 0; i < count; i++) {
+        float value = values[i];
+        low = value < low ? value : low;
+        high = value > high ? value : high;
+    }
+}
+
+template <typename T> float sum(const T *values, int64_t count) {
+    float total = 0.0f;
+    for (int64_t i = 0; i < count; i++) {
+        total += values[i];
+    }
+    return total;
+}
+
+// Rounds towards negative infinity, buckets before the history are negative
+int64_t floor_div(int64_t a, int64_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+int64_t Transform::bucket_start(int64_t bucket) const {
+    return floor_div(bucket * Device::hist_size, std::max(_width, 1));
+}
+
+int64_t Transform::newest_bucket(uint64_t generation) const {
+    // The last bucket starting at or before sample generation - 1
+    int64_t width = std::max(_width, 1);
+    return floor_div(static_cast<int64_t>(generation) * width - 1,
+                     Device::hist_size);
+}
+
+int Transform::samples() const { return _width > 0 ? Device::hist_size : 0; }
+
+void Transform::set_mode(Mode mode) {
+    _mode = mode;
+    _valid = false;
+}
+
+void Transform::fill(const Device &device, int first, int last,
+                     uint64_t generation) {
+    const int64_t newest = newest_bucket(generation);
+    const int64_t end = generation;
+    const int64_t oldest = std::max<int64_t>(end - Device::hist_size, 0);
+    // Samples [begin, stop) of a bucket, at least one when the graph is wider
+    // than the history
+    auto span = [&](int64_t bucket, int64_t &begin, int64_t &stop) {
+        int64_t start = bucket_start(bucket);
+        begin = std::max(start, oldest);
+        stop = std::min(std::max(bucket_start(bucket + 1), start + 1), end);
+    };
+
+    auto reduce = [&](const auto *ring) {
+        auto at = [&](int64_t sample) -> float {
+            return ring[sample % Device::hist_size];
+        };
+        for (int column = first; column < last; column++) {
+            int64_t bucket = newest - (_width - 1 - column);
+            int64_t begin, stop;
+            span(bucket, begin, stop);
+            // Buckets from before the history started are left blank
+            if (begin >= stop) {
+                _columns[column] = {};
+                continue;
+            }
+            float low = at(begin);
+            float high = low;
+            if (_mode == Mode::MinMax) {
+                for_each_run(ring, begin, stop,
+                             [&](const auto *values, int64_t count) {
+                                 min_max(values, count, low, high);
+                             });
+            } else if (_mode == Mode::LTTB && stop - begin > 1) {
+                low = high = at(stop - 1);
+                // The newest bucket keeps its newest sample
+                int64_t previous_begin, previous_stop, next_begin, next_stop;
+                span(bucket - 1, previous_begin, previous_stop);
+                span(bucket + 1, next_begin, next_stop);
+                if (next_stop > next_begin && previous_stop > previous_begin) {
+                    auto average = [&](int64_t from, int64_t to) {
+                        float total = 0.0f;
+                        for_each_run(ring, from, to,
+                                     [&](const auto *values, int64_t count) {
+                                         total += sum(values, count);
+                                     });
+                        return total / (to - from);
+                    };
+                    float previous_value =
+                        average(previous_begin, previous_stop);
+                    float previous_x =
+                        (previous_begin + previous_stop - 1) / 2.0f;
+                    float next_value = average(next_begin, next_stop);
+                    float next_x =
+                        (next_begin + next_stop - 1) / 2.0f - previous_x;
+                    float best = -1.0f;
+                    for (int64_t sample = begin; sample < stop; sample++) {
+                        float x = sample - previous_x;
+                        float value = at(sample);
+                        float area =
+                            std::fabs(next_x * (value - previous_value) -
+                                      x * (next_value - previous_value));
+                        if (area > best) {
+                            best = area;
+                            low = high = value;
+                        }
+                    }
+                }
+            }
+            _columns[column] = {static_cast<int>(low * _height),
+                                static_cast<int>(high * _height)};
+        }
+    };
+    if (device.type == Type::Analog) {
+        reduce(device.get_value_analog_ring());
+    } else {
+        reduce(device.get_value_digital_ring());
+    }
+}
+
+const std::vector<Column> &Transform::update(const Device &device, int width,
+                                             int height) {
+    uint64_t generation = device.hist_generation();
+    if (!_valid || width != _width || height != _height) {
+        _width = width;
+        _height = height;
+        // Only allocates when the graph grows
+        _columns.resize(width);
+        fill(device, 0, width, generation);
+    } else if (generation != _generation) {
+        int64_t previous = newest_bucket(_generation);
+        int64_t shift = newest_bucket(generation) - previous;
+        if (shift >= width) {
+            fill(device, 0, width, generation);
+        } else {
+            std::copy(_columns.begin() + shift, _columns.end(),
+                      _columns.begin());
+            // The previously newest bucket may have gained samples too, and
+            // under LTTB the one before it aimed at that bucket
+            int64_t redo = shift + (_mode == Mode::LTTB ? 2 : 1);
+            int first = width - redo;
+            fill(device, std::max(first, 0), width, generation);
+            if (_mode == Mode::LTTB) {
+                // Its left neighbour is partly gone from the history
+                fill(device, 0, 1, generation);
+            }
+        }
+    }
+    _generation = generation;
+    _valid = true;
+    return _columns;
+}
+
+// Bits lighting the dots from low to high of a braille character's left or
+// right column. Heights run 0 to 4, a full scale value being the top dot.
+using Bands = std::array<std::array<std::array<uint8_t, 5>, 5>, 2>;
+
+const Bands &bands() {
+    static const Bands bands = [] {
+        Bands bands{};
+        for (int side = 0; side < 2; side++) {
+            for (int low = 0; low <= 4; low++) {
+                for (int high = low; high <= 4; high++) {
+                    for (int dot = std::min(low, 3); dot <= std::min(high, 3);
+                         dot++) {
+                        bands[side][low][high] |= braille_dots[side][dot];
+                    }
+                }
+            }
+        }
+        return bands;
+    }();
+    return bands;
+}
+
+const std::string &Sparkline::update(const Device &device, int width) {
+    uint64_t generation = device.hist_generation();
+    if (_valid && width == _width && generation == _generation) {
+        return _text;
+    }
+    const auto &columns = _transform.update(device, 2 * width, 4);
+    const Bands &lut = bands();
+    auto height = [](int value) { return std::clamp(value, 0, 4); };
+    _text.resize(3 * width);
+    for (int i = 0; i < width; i++) {
+        const Column &left = columns[2 * i];
+        const Column &right = columns[2 * i + 1];
+        uint8_t bits = lut[0][height(left.low)][height(left.high)] |
+                       lut[1][height(right.low)][height(right.high)];
+        braille_utf8(bits, &_text[3 * i]);
+    }
+    _width = width;
+    _generation = generation;
+    _valid = true;
+    return _text;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+// std library headers
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Devices {
+
+class Device;
+
+namespace Graph {
+
+// How the samples falling into one column are reduced
+enum class Mode { Nearest, MinMax, LTTB };
+
+const std::array<Mode, 3> all_modes = {Mode::Nearest, Mode::MinMax,
+                                       Mode::LTTB};
+
+inline std::string mode_to_string(Mode mode) {
+    switch (mode) {
+    case Mode::Nearest:
+        return "Nearest";
+    case Mode::MinMax:
+        return "Min/Max";
+    case Mode::LTTB:
+        return "LTTB";
+    default:
+        return "Unknown";
+    }
+}
+
+// Dot bits of a braille character, U+2800 plus the bits, for the left and
+// right column from the bottom up
+constexpr uint8_t braille_dots[2][4] = {{0x40, 0x04, 0x02, 0x01},
+                                        {0x80, 0x20, 0x10, 0x08}};
+
+// Writes the three bytes of UTF-8 for the braille character with these dots
+inline void braille_utf8(uint8_t bits, char *out) {
+    out[0] = static_cast<char>(0xE2);
+    out[1] = static_cast<char>(0xA0 | (bits >> 6));
+    out[2] = static_cast<char>(0x80 | (bits & 0x3F));
+}
+
+// Drawn as a band from low to high, the two are equal for a single value
+struct Column {
+    int low = 0;
+    int high = 0;
+
+    bool operator==(const Column &other) const {
+        return low == other.low && high == other.high;
+    }
+};
+
+// Column heights for a device's history graph, kept between frames.
+//
+// Samples are grouped into one bucket per column, aligned to the absolute
+// sample count, so a new sample either lands in the newest bucket or starts
+// a new one: the columns shift left and only the newest buckets are
+// recomputed. Bucket b starts at sample floor(b * hist_size / width), so any
+// width buckets in a row span exactly the whole history. A graph narrower
+// than the history puts hist_size / width samples in a column, rounded
+// either way, a wider one repeats samples across columns.
+//
+// Nearest keeps the first sample of each bucket. MinMax keeps the whole
+// range so a one sample spike still shows up. LTTB (largest triangle three
+// buckets) keeps the sample forming the largest triangle with the averages
+// of the buckets either side. Classic LTTB anchors on the previous pick
+// instead, but then one changed bucket ripples through every pick after it.
+class Transform {
+  public:
+    // Columns for the given size, valid until the next call. Reads the
+    // history, so the caller holds the history lock.
+    const std::vector<Column> &update(const Device &device, int width,
+                                      int height);
+
+    Mode mode() const { return _mode; }
+    void set_mode(Mode mode);
+    // Samples spanned by the columns from the last update
+    int samples() const;
+
+  private:
+    Mode _mode = Mode::MinMax;
+    int _width = 0;
+    int _height = 0;
+    uint64_t _generation = 0;
+    bool _valid = false;
+    std::vector<Column> _columns;
+
+    // First absolute sample of a bucket
+    int64_t bucket_start(int64_t bucket) const;
+    int64_t newest_bucket(uint64_t generation) const;
+    // Recomputes columns [first, last) for the given generation
+    void fill(const Device &device, int first, int last, uint64_t generation);
+};
+
+// Braille sparkline of a device's history. Each character is 2 x 4 dots, so
+// it covers two columns of a min/max transform four dots high, drawn as the
+// band between each column's lowest and highest sample.
+class Sparkline {
+  public:
+    // UTF-8 text width characters wide, rebuilt only when the history has
+    // changed. Reads the history, so the caller holds the history lock.
+    const std::string &update(const Device &device, int width);
+
+  private:
+    Transform _transform;
+    int _width = 0;
+    uint64_t _generation = 0;
+    bool _valid = false;
+    std::string _text;
+};
+
+} // namespace Graph
+
+} // namespace Devices
@@ -0,0 +1,346 @@
+// std library headers
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// POSIX headers
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "metrics.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "remote.h"
+#include "trace.h"
+
+using namespace Devices;
+using namespace Devices::Metrics;
+
+// Wide enough for any double in shortest form
+const size_t field_width = 24;
+const size_t max_request_bytes = 8192;
+
+struct Stage {
+    const char *name;
+    Perf::Series Perf::Counters::*series;
+};
+
+const Stage stages[] = {
+    {"update_values", &Perf::Counters::update_values_pass},
+    {"record_to_hist", &Perf::Counters::record_to_hist_pass},
+    {"record_hist_wait", &Perf::Counters::record_hist_wait},
+    {"record_hist_hold", &Perf::Counters::record_hist_hold},
+    {"ui_frame", &Perf::Counters::ui_frame},
+    {"ui_hist_wait", &Perf::Counters::ui_hist_wait},
+    {"ui_hist_hold", &Perf::Counters::ui_hist_hold},
+    {"metrics_scrape", &Perf::Counters::metrics_scrape},
+};
+
+const char *stage_stats[] = {"p50", "p99", "max"};
+
+// Label values escape backslash, double quote and newline
+std::string escape(const std::string &value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+int level_number(Pipeline::Level level) {
+    switch (level) {
+    case Pipeline::Level::Warning:
+        return 3;
+    case Pipeline::Level::Caution:
+        return 2;
+    case Pipeline::Level::Optimal:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+double seconds(std::chrono::nanoseconds ns) { return ns.count() / 1e9; }
+
+Exposition::Exposition(const std::vector<std::unique_ptr<Device>> &devices,
+                       const Actuators::Queue &queue,
+                       const Remote::Server *server)
+    : _devices(devices), _queue(queue), _server(server) {
+    auto family = [&](const char *name, const char *type, const char *help) {
+        _text += "# HELP ";
+        _text += name;
+        _text += " ";
+        _text += help;
+        _text += "\n# TYPE ";
+        _text += name;
+        _text += " ";
+        _text += type;
+        _text += "\n";
+    };
+
+    family("devices_value", "gauge",
+           "Current value, in relative units for analog devices and 1/0 "
+           "for active/inactive digital ones.");
+    for (const auto &device : devices) {
+        _values.push_back(line("devices_value",
+                               "{device=\"" + escape(device->name) +
+                                   "\",type=\"" +
+                                   (device->type == Type::Analog ? "analog"
+                                                                 : "digital") +
+                                   "\"}"));
+    }
+    family("devices_alarm_level", "gauge",
+           "Threshold range of an analog device's value: 0 none, 1 optimal, "
+           "2 caution, 3 warning.");
+    for (const auto &device : devices) {
+        if (device->type == Type::Analog) {
+            _levels.push_back(line("devices_alarm_level",
+                                   "{device=\"" + escape(device->name) +
+                                       "\"}"));
+        }
+    }
+    family("devices_stage_seconds", "gauge",
+           "Median, 99th percentile and longest of the recent durations of "
+           "each stage.");
+    for (const auto &stage : stages) {
+        for (const char *stat : stage_stats) {
+            _stages.push_back(line("devices_stage_seconds",
+                                   std::string("{stage=\"") + stage.name +
+                                       "\",stat=\"" + stat + "\"}"));
+        }
+    }
+    family("devices_queue_depth", "gauge",
+           "Actuator commands waiting to be written.");
+    _queue_fields.push_back(line("devices_queue_depth", ""));
+    family("devices_queue_commands_total", "counter",
+           "Actuator commands by what became of them.");
+    for (const char *outcome :
+         {"submitted", "coalesced", "redundant", "deferred", "written"}) {
+        _queue_fields.push_back(
+            line("devices_queue_commands_total",
+                 std::string("{outcome=\"") + outcome + "\"}"));
+    }
+    family("devices_queue_batches_total", "counter",
+           "Backend writes, each a batch of commands.");
+    _queue_fields.push_back(line("devices_queue_batches_total", ""));
+    family("devices_queue_max_latency_seconds", "gauge",
+           "Longest a command has waited to be written.");
+    _queue_fields.push_back(line("devices_queue_max_latency_seconds", ""));
+    family("devices_queue_max_sample_latency_seconds", "gauge",
+           "Longest from a command's inputs being sampled to its write.");
+    _queue_fields.push_back(
+        line("devices_queue_max_sample_latency_seconds", ""));
+    if (_server != nullptr) {
+        family("devices_remote_clients", "gauge",
+               "Views attached over the Unix socket.");
+        _clients = line("devices_remote_clients", "");
+    }
+}
+
+size_t Exposition::line(const std::string &name, const std::string &labels) {
+    _text += name;
+    _text += labels;
+    _text += ' ';
+    size_t field = _text.size();
+    _text.append(field_width, ' ');
+    _text += '\n';
+    _series++;
+    return field;
+}
+
+// Right aligned, so the blanks before it just separate it from the labels
+void Exposition::set(size_t field, double value) {
+    char buffer[field_width];
+    size_t size;
+    // The text format spells these NaN, +Inf and -Inf, to_chars doesn't
+    if (!std::isfinite(value)) {
+        const char *special =
+            std::isnan(value) ? "NaN" : (value > 0 ? "+Inf" : "-Inf");
+        size = std::strlen(special);
+        std::memcpy(buffer, special, size);
+    } else {
+        size = std::to_chars(buffer, buffer + field_width, value).ptr - buffer;
+    }
+    std::memset(&_text[field], ' ', field_width - size);
+    std::memcpy(&_text[field + field_width - size], buffer, size);
+}
+
+void Exposition::set(size_t field, uint64_t value) {
+    char buffer[field_width];
+    auto result = std::to_chars(buffer, buffer + field_width, value);
+    size_t size = result.ptr - buffer;
+    std::memset(&_text[field], ' ', field_width - size);
+    std::memcpy(&_text[field + field_width - size], buffer, size);
+}
+
+const std::string &Exposition::update() {
+    TRACE_SPAN("metrics update");
+    auto &counters = Perf::counters();
+    const Perf::Timer scrape(counters.metrics_scrape);
+    size_t level = 0;
+    for (size_t i = 0; i < _devices.size(); i++) {
+        const Device &device = *_devices[i];
+        set(_values[i], static_cast<double>(device.get_value_scaled()));
+        if (device.type == Type::Analog) {
+            set(_levels[level++], static_cast<uint64_t>(level_number(
+                                      Pipeline::level_of(device))));
+        }
+    }
+    size_t field = 0;
+    for (const auto &stage : stages) {
+        auto summary = (counters.*stage.series).summary();
+        set(_stages[field++], seconds(summary.p50));
+        set(_stages[field++], seconds(summary.p99));
+        set(_stages[field++], seconds(summary.max));
+    }
+    const auto &queue = _queue.counters();
+    set(_queue_fields[0], queue.depth.load());
+    set(_queue_fields[1], queue.submitted.load());
+    set(_queue_fields[2], queue.coalesced.load());
+    set(_queue_fields[3], queue.redundant.load());
+    set(_queue_fields[4], queue.deferred.load());
+    set(_queue_fields[5], queue.written.load());
+    set(_queue_fields[6], queue.batches.load());
+    set(_queue_fields[7], queue.max_latency_ns.load() / 1e9);
+    set(_queue_fields[8], queue.max_sample_latency_ns.load() / 1e9);
+    if (_server != nullptr) {
+        set(_clients, static_cast<uint64_t>(_server->clients()));
+    }
+    return _text;
+}
+
+Exporter::Exporter(const std::vector<std::unique_ptr<Device>> &devices,
+                   const Actuators::Queue &queue,
+                   const Remote::Server *server, int port)
+    : _exposition(devices, queue, server), _port(port) {}
+
+Exporter::~Exporter() { stop(); }
+
+bool Exporter::start() {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_port);
+    // Only for monitoring on this machine
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    _fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    if (_fd < 0 ||
+        ::setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) !=
+            0 ||
+        ::bind(_fd, reinterpret_cast<sockaddr *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(_fd, 4) != 0) {
+        std::cerr << "Failed to serve metrics on port " << _port << ": "
+                  << std::strerror(errno) << std::endl;
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+        return false;
+    }
+    Perf::enable();
+    _running = true;
+    _thread = std::thread([this] { serve(); });
+    return true;
+}
+
+void Exporter::stop() {
+    if (!_running.exchange(false)) {
+        return;
+    }
+    _thread.join();
+    ::close(_fd);
+    _fd = -1;
+    Perf::disable();
+}
+
+void Exporter::serve() {
+    TRACE_THREAD("metrics");
+    std::string request;
+    std::string header;
+    while (_running) {
+        pollfd listening = {_fd, POLLIN, 0};
+        if (::poll(&listening, 1, 250) <= 0) {
+            continue;
+        }
+        int fd = ::accept4(_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        // A stuck scraper only holds up the next one this long
+        timeval timeout = {1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        request.clear();
+        char chunk[1024];
+        while (request.find("\r\n\r\n") == std::string::npos &&
+               request.size() < max_request_bytes) {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                break;
+            }
+            request.append(chunk, n);
+        }
+        const std::string *body = nullptr;
+        if (request.rfind("GET /metrics ", 0) == 0 ||
+            request.rfind("GET / ", 0) == 0) {
+            body = &_exposition.update();
+            header = "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: " +
+                     std::to_string(body->size()) +
+                     "\r\nConnection: close\r\n\r\n";
+        } else {
+            header = "HTTP/1.1 404 Not Found\r\n"
+                     "Content-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        iovec parts[2] = {{header.data(), header.size()},
+                          {nullptr, 0}};
+        if (body != nullptr) {
+            parts[1] = {const_cast<char *>(body->data()), body->size()};
+        }
+        size_t total = header.size() + (body ? body->size() : 0);
+        size_t sent = 0;
+        while (sent < total) {
+            msghdr message{};
+            message.msg_iov = parts;
+            message.msg_iovlen = 2;
+            ssize_t n = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            sent += n;
+            // Skip whatever went out
+            for (auto &part : parts) {
+                size_t skip = std::min<size_t>(n, part.iov_len);
+                part.iov_base = static_cast<char *>(part.iov_base) + skip;
+                part.iov_len -= skip;
+                n -= skip;
+            }
+        }
+        ::close(fd);
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// std library headers
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "perf.h"
+#include "remote.h"
+
+namespace Devices {
+
+namespace Metrics {
+
+// Prometheus text exposition of device values, alarm levels, stage timings
+// and the actuator queue. The text is laid out once with every value in a
+// fixed width field, and an update only writes the current values into their
+// fields: no allocation, and only atomics are read, never the history lock.
+class Exposition {
+  public:
+    // Nothing to report on remote clients without a server
+    Exposition(const std::vector<std::unique_ptr<Device>> &devices,
+               const Actuators::Queue &queue,
+               const Remote::Server *server = nullptr);
+
+    // The text with current values, valid until the next call
+    const std::string &update();
+    size_t series() const { return _series; }
+
+  private:
+    const std::vector<std::unique_ptr<Device>> &_devices;
+    const Actuators::Queue &_queue;
+    const Remote::Server *_server;
+    std::string _text;
+    size_t _series = 0;
+
+    // Field offsets in _text, in the order update() fills them
+    std::vector<size_t> _values;
+    std::vector<size_t> _levels;
+    std::vector<size_t> _stages;
+    std::vector<size_t> _queue_fields;
+    size_t _clients = 0;
+
+    // Appends a series line and returns where its value goes
+    size_t line(const std::string &name, const std::string &labels);
+    void set(size_t field, double value);
+    void set(size_t field, uint64_t value);
+};
+
+// Serves the exposition over HTTP on a localhost port, one scrape at a time
+// on its own thread. Turns on Perf recording while running.
+class Exporter {
+  public:
+    Exporter(const std::vector<std::unique_ptr<Device>> &devices,
+             const Actuators::Queue &queue, const Remote::Server *server,
+             int port);
+    ~Exporter();
+
+    bool start();
+    void stop();
+
+  private:
+    Exposition _exposition;
+    int _port;
+    int _fd = -1;
+    std::atomic<bool> _running{false};
+    std::thread _thread;
+
+    void serve();
+};
+
+} // namespace Metrics
+
+} // namespace Devices
@@ -0,0 +1,48 @@
+// std library headers
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Local headers
+#include "perf.h"
+
+using namespace Devices;
+using namespace Devices::Perf;
+
+std::atomic<int> recording{0};
+
+bool Perf::enabled() { return recording.load(std::memory_order_relaxed) > 0; }
+
+void Perf::enable() { recording.fetch_add(1); }
+
+void Perf::disable() { recording.fetch_sub(1); }
+
+Summary Series::summary() const {
+    Summary summary;
+    summary.count = _count.load(std::memory_order_acquire);
+    size_t size = std::min<uint64_t>(summary.count, capacity);
+    if (size == 0) {
+        return summary;
+    }
+    std::array<int64_t, capacity> ns;
+    for (size_t i = 0; i < size; i++) {
+        ns[i] = _ns[i].load(std::memory_order_relaxed);
+    }
+    auto at = [&](double p) {
+        size_t i = std::min(size - 1, static_cast<size_t>(p * size));
+        std::nth_element(ns.begin(), ns.begin() + i, ns.begin() + size);
+        return std::chrono::nanoseconds(ns[i]);
+    };
+    summary.p50 = at(0.5);
+    summary.p99 = at(0.99);
+    summary.max = std::chrono::nanoseconds(
+        *std::max_element(ns.begin(), ns.begin() + size));
+    return summary;
+}
+
+Counters &Perf::counters() {
+    static Counters counters;
+    return counters;
+}
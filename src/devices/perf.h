@@ -0,0 +1,135 @@
+#pragma once
+
+// std library headers
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// Local headers
+#include "trace.h"
+
+namespace Devices {
+
+namespace Perf {
+
+using Clock = std::chrono::steady_clock;
+
+// Recording is off until something wants the numbers, the performance
+// overlay or the metrics exporter. While off every timer and lock below
+// costs one relaxed load.
+bool enabled();
+// Recording stays on until every enable() has had its disable()
+void enable();
+void disable();
+
+struct Summary {
+    uint64_t count = 0;
+    std::chrono::nanoseconds p50{0};
+    std::chrono::nanoseconds p99{0};
+    std::chrono::nanoseconds max{0};
+};
+
+// The most recent durations of one thing. Only one thread records into a
+// series, so recording is two relaxed stores, and any thread can summarize.
+class Series {
+  public:
+    static const size_t capacity = 256;
+
+    void record(Clock::duration duration) {
+        uint64_t count = _count.load(std::memory_order_relaxed);
+        _ns[count % capacity].store(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+                .count(),
+            std::memory_order_relaxed);
+        _count.store(count + 1, std::memory_order_release);
+    }
+
+    // Percentiles over what's still in the ring
+    Summary summary() const;
+
+  private:
+    std::array<std::atomic<int64_t>, capacity> _ns{};
+    std::atomic<uint64_t> _count{0};
+};
+
+// Records how long the scope took
+class Timer {
+  public:
+    explicit Timer(Series &series) : _series(enabled() ? &series : nullptr) {
+        if (_series != nullptr) {
+            _start = Clock::now();
+        }
+    }
+    ~Timer() {
+        if (_series != nullptr) {
+            _series->record(Clock::now() - _start);
+        }
+    }
+
+  private:
+    Series *_series;
+    Clock::time_point _start;
+};
+
+// Lock guard recording how long it waited for the mutex and how long it
+// held it
+class TimedLock {
+  public:
+    TimedLock(std::mutex &mutex, Series &wait, Series &hold)
+        : _mutex(mutex), _hold(enabled() ? &hold : nullptr) {
+        if (_hold == nullptr) {
+            TRACE_SPAN("lock wait");
+            _mutex.lock();
+            return;
+        }
+        auto start = Clock::now();
+        {
+            TRACE_SPAN("lock wait");
+            _mutex.lock();
+        }
+        _locked = Clock::now();
+        wait.record(_locked - start);
+    }
+    ~TimedLock() {
+        if (_hold == nullptr) {
+            _mutex.unlock();
+            return;
+        }
+        auto unlocked = Clock::now();
+        _mutex.unlock();
+        _hold->record(unlocked - _locked);
+    }
+    TimedLock(const TimedLock &) = delete;
+    TimedLock &operator=(const TimedLock &) = delete;
+
+  private:
+    std::mutex &_mutex;
+    Series *_hold;
+    Clock::time_point _locked;
+};
+
+// Everything the overlay shows, each series named after the one thread
+// recording into it
+struct Counters {
+    // From starting to build a frame to drawing its last cell
+    Series ui_frame;
+    Series ui_hist_wait;
+    Series ui_hist_hold;
+    Series record_hist_wait;
+    Series record_hist_hold;
+    Series update_values_pass;
+    Series record_to_hist_pass;
+    // Filling in the metrics exposition for one scrape
+    Series metrics_scrape;
+    // Redraws posted to the UI loop and taken off it, always counted
+    std::atomic<uint64_t> events_posted{0};
+    std::atomic<uint64_t> events_handled{0};
+};
+
+Counters &counters();
+
+} // namespace Perf
+
+} // namespace Devices
@@ -0,0 +1,405 @@
+// std library headers
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// POSIX headers
+#include <fcntl.h>
+#include <unistd.h>
+
+// 3rd party headers
+// ---- tomlplusplus ----
+#include <toml++/toml.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "bytes.h"
+#include "control.h"
+#include "devices.h"
+#include "events.h"
+#include "expr.h"
+#include "format.h"
+#include "metrics.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "remote.h"
+#include "schedule.h"
+#include "trace.h"
+
+using namespace Devices;
+using namespace Devices::Pipeline;
+
+const char history_magic[4] = {'D', 'H', 'S', 'T'};
+const uint32_t history_version = 1;
+const size_t history_header_bytes = sizeof(history_magic) +
+                                    3 * sizeof(uint32_t);
+const size_t history_ring_bytes = Device::hist_size *
+                                  (sizeof(float) + sizeof(int));
+
+Level Pipeline::level_of(const Device &device) {
+    if (device.type != Type::Analog) {
+        return Level::None;
+    }
+    float value = device.get_value_scaled();
+    if (device.is_warning(value)) {
+        return Level::Warning;
+    } else if (device.is_caution(value)) {
+        return Level::Caution;
+    } else if (device.is_optimal(value)) {
+        return Level::Optimal;
+    }
+    return Level::None;
+}
+
+Runner::Runner(std::vector<std::unique_ptr<Device>> &devices,
+               std::vector<std::unique_ptr<Control::Loop>> &loops,
+               Schedule::Scheduler &scheduler, Actuators::Queue &queue,
+               const Settings &settings)
+    : _devices(devices), _loops(loops), _scheduler(scheduler), _queue(queue),
+      _settings(settings) {
+    for (auto &device : _devices) {
+        device->watch(&_changes);
+    }
+}
+
+Runner::~Runner() { stop(); }
+
+void Runner::start() {
+    if (_running.exchange(true)) {
+        return;
+    }
+    if (!_settings.history_path.empty()) {
+        _restored = load_history();
+    }
+    _threads.emplace_back([this] { update_values(); });
+    _threads.emplace_back([this] { record_to_hist(); });
+    _threads.emplace_back([this] { control(); });
+    _threads.emplace_back([this] { schedule(); });
+    _threads.emplace_back([this] { actuate(); });
+    if (!_settings.history_path.empty()) {
+        _threads.emplace_back([this] { persist(); });
+    }
+    if (!_settings.socket_path.empty()) {
+        _server = std::make_unique<Remote::Server>(
+            _devices, _hist_lock, _changes, _queue, _settings.socket_path);
+        if (!_server->start()) {
+            _server.reset();
+        }
+    }
+    if (_settings.metrics_port > 0) {
+        _exporter = std::make_unique<Metrics::Exporter>(
+            _devices, _queue, _server.get(), _settings.metrics_port);
+        if (!_exporter->start()) {
+            _exporter.reset();
+        }
+    }
+}
+
+void Runner::stop() {
+    if (!_running.exchange(false)) {
+        return;
+    }
+    if (_exporter) {
+        _exporter->stop();
+        _exporter.reset();
+    }
+    if (_server) {
+        _server->stop();
+        _server.reset();
+    }
+    {
+        // Pairs with the wait in persist() so the wakeup isn't lost
+        const std::lock_guard<std::mutex> lg(_stop_lock);
+    }
+    _stopping.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+    _threads.clear();
+    _changes.publish();
+    if (!_settings.history_path.empty()) {
+        flush_history();
+    }
+}
+
+void Runner::update_values() {
+    TRACE_THREAD("update_values");
+    Expressions::Engine derived(_devices);
+    while (_running) {
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(0.05s);
+        {
+            TRACE_SPAN("update_values");
+            const Perf::Timer pass(Perf::counters().update_values_pass);
+            for (auto &device : _devices) {
+                device->update_value();
+            }
+            derived.update();
+        }
+        _changes.publish();
+    }
+}
+
+void Runner::record_to_hist() {
+    TRACE_THREAD("record_to_hist");
+    while (_running) {
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(0.25s);
+        {
+            auto &counters = Perf::counters();
+            const Perf::TimedLock lg(_hist_lock, counters.record_hist_wait,
+                                     counters.record_hist_hold);
+            const Perf::Timer pass(counters.record_to_hist_pass);
+            TRACE_SPAN("record_value_to_hist");
+            for (auto &device : _devices) {
+                device->record_value_to_hist();
+            }
+        }
+        _changes.publish();
+        if (_settings.alarms || Events::enabled()) {
+            check_alarms();
+        }
+    }
+}
+
+void Runner::control() {
+    TRACE_THREAD("control");
+    Control::Engine controllers(_loops, _devices, _queue);
+    while (_running) {
+        using namespace std::chrono_literals;
+        // Wake at least every 50 ms to notice shutdown
+        auto next = controllers.step();
+        std::this_thread::sleep_until(
+            std::min(next, Control::Loop::Clock::now() + 50ms));
+    }
+}
+
+void Runner::schedule() {
+    TRACE_THREAD("schedule");
+    while (_running) {
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(0.25s);
+        _scheduler.advance(std::time(nullptr));
+    }
+}
+
+void Runner::actuate() {
+    TRACE_THREAD("actuate");
+    while (_running) {
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(0.05s);
+        _queue.flush(Actuators::Clock::now());
+        _changes.publish();
+    }
+}
+
+void Runner::persist() {
+    TRACE_THREAD("persist");
+    std::unique_lock<std::mutex> ul(_stop_lock);
+    while (true) {
+        _stopping.wait_for(ul, _settings.history_interval,
+                           [&] { return !_running; });
+        if (!_running) {
+            break;
+        }
+        ul.unlock();
+        flush_history();
+        ul.lock();
+    }
+}
+
+// Logs an event and, with alarms on, prints one line per analog device that
+// moved to another threshold range. The first pass only reports devices
+// already outside the optimal ranges.
+void Runner::check_alarms() {
+    TRACE_SPAN("check_alarms");
+    std::string lines;
+    _levels.resize(_devices.size(), Level::None);
+    for (size_t i = 0; i < _devices.size(); i++) {
+        const Device &device = *_devices[i];
+        Level level = level_of(device);
+        bool report = _levels_valid
+                          ? level != _levels[i]
+                          : level == Level::Warning || level == Level::Caution;
+        _levels[i] = level;
+        if (!report) {
+            continue;
+        }
+        Events::alarm(i, level, device.get_value_scaled());
+        if (!_settings.alarms) {
+            continue;
+        }
+        lines += device.name;
+        lines += ": ";
+        lines += level_to_string(level);
+        lines += " at ";
+        lines += float_to_string(device.get_value_scaled());
+        if (device.units_abbreviation.has_value()) {
+            lines += " ";
+            lines += device.units_abbreviation.value();
+        }
+        lines += "\n";
+    }
+    _levels_valid = true;
+    if (!lines.empty()) {
+        std::cout << lines << std::flush;
+    }
+}
+
+bool Runner::flush_history() {
+    if (_settings.history_path.empty()) {
+        return false;
+    }
+    TRACE_SPAN("flush_history");
+    const std::lock_guard<std::mutex> flush(_flush_lock);
+    std::string &buffer = _history_buffer;
+    buffer.clear();
+    buffer.append(history_magic, sizeof(history_magic));
+    Bytes::append<uint32_t>(buffer, history_version);
+    Bytes::append<uint32_t>(buffer, Device::hist_size);
+    Bytes::append<uint32_t>(buffer, _devices.size());
+    {
+        // Only copies, the file is written after letting go
+        const std::lock_guard<std::mutex> lg(_hist_lock);
+        for (const auto &device : _devices) {
+            size_t name_bytes = std::min<size_t>(device->name.size(),
+                                                 UINT16_MAX);
+            Bytes::append<uint16_t>(buffer, name_bytes);
+            buffer.append(device->name.data(), name_bytes);
+            Bytes::append<uint8_t>(buffer, static_cast<uint8_t>(device->type));
+            Bytes::append<uint64_t>(buffer, device->hist_generation());
+            buffer.append(
+                reinterpret_cast<const char *>(device->get_value_analog_ring()),
+                Device::hist_size * sizeof(float));
+            buffer.append(
+                reinterpret_cast<const char *>(
+                    device->get_value_digital_ring()),
+                Device::hist_size * sizeof(int));
+        }
+    }
+    std::string temp = _settings.history_path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    bool ok = fd >= 0;
+    size_t written = 0;
+    while (ok && written < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + written,
+                            buffer.size() - written);
+        ok = n >= 0;
+        written += ok ? n : 0;
+    }
+    ok = ok && ::fdatasync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!ok || ::rename(temp.c_str(), _settings.history_path.c_str()) != 0) {
+        std::cerr << "Failed to save history to " << _settings.history_path
+                  << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+size_t Runner::load_history() {
+    std::ifstream in(_settings.history_path, std::ios::binary);
+    if (!in) {
+        // Nothing saved yet
+        return 0;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    size_t offset = sizeof(history_magic);
+    if (data.size() < history_header_bytes ||
+        std::memcmp(data.data(), history_magic, sizeof(history_magic)) != 0 ||
+        Bytes::get<uint32_t>(data.data(), offset) != history_version ||
+        Bytes::get<uint32_t>(data.data(), offset) != Device::hist_size) {
+        std::cerr << "Ignoring history in " << _settings.history_path
+                  << ", not a history file of this version" << std::endl;
+        return 0;
+    }
+    uint32_t count = Bytes::get<uint32_t>(data.data(), offset);
+    std::unordered_map<std::string, Device *> by_name;
+    for (auto &device : _devices) {
+        by_name[device->name] = device.get();
+    }
+    size_t restored = 0;
+    std::string name;
+    std::vector<float> analog(Device::hist_size);
+    std::vector<int> digital(Device::hist_size);
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset + sizeof(uint16_t) > data.size()) {
+            break;
+        }
+        uint16_t name_bytes = Bytes::get<uint16_t>(data.data(), offset);
+        if (offset + name_bytes + sizeof(uint8_t) + sizeof(uint64_t) +
+                history_ring_bytes >
+            data.size()) {
+            break;
+        }
+        name.assign(data.data() + offset, name_bytes);
+        offset += name_bytes;
+        auto type = static_cast<Type>(Bytes::get<uint8_t>(data.data(), offset));
+        uint64_t generation = Bytes::get<uint64_t>(data.data(), offset);
+        std::memcpy(analog.data(), data.data() + offset,
+                    Device::hist_size * sizeof(float));
+        offset += Device::hist_size * sizeof(float);
+        std::memcpy(digital.data(), data.data() + offset,
+                    Device::hist_size * sizeof(int));
+        offset += Device::hist_size * sizeof(int);
+        // Devices renamed or retyped since start over
+        auto it = by_name.find(name);
+        if (it == by_name.end() || it->second->type != type) {
+            continue;
+        }
+        it->second->restore_hist(generation, analog.data(), digital.data());
+        restored++;
+    }
+    return restored;
+}
+
+void Pipeline::from_toml(Settings &settings, const std::string &toml_path) {
+    try {
+        auto config = toml::parse_file(toml_path);
+        settings.history_path =
+            config["Pipeline"]["history_path"].value_or<std::string>("");
+        settings.history_interval = std::chrono::seconds(
+            config["Pipeline"]["history_interval_s"].value_or<int64_t>(
+                settings.history_interval.count()));
+        settings.alarms =
+            config["Pipeline"]["alarms"].value_or<bool>(settings.alarms);
+        settings.socket_path =
+            config["Pipeline"]["socket"].value_or<std::string>("");
+        settings.metrics_port =
+            config["Pipeline"]["metrics_port"].value_or<int>(
+                settings.metrics_port);
+        // The writer waits this long between saves, never spin on it
+        if (settings.history_interval.count() <= 0) {
+            std::string error = "history_interval_s must be positive, using 1";
+            std::cerr << "Failed to parse TOML: " << error << std::endl;
+            Events::config(toml_path, error);
+            settings.history_interval = std::chrono::seconds(1);
+        }
+        if (settings.metrics_port < 0 || settings.metrics_port > 65535) {
+            std::string error = "metrics_port " +
+                                std::to_string(settings.metrics_port) +
+                                " is out of range, not serving metrics";
+            std::cerr << "Failed to parse TOML: " << error << std::endl;
+            Events::config(toml_path, error);
+            settings.metrics_port = 0;
+        }
+    } catch (const toml::parse_error &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    }
+}
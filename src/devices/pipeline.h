@@ -0,0 +1,135 @@
+#pragma once
+
+// std library headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local headers
+#include "actuator.h"
+#include "control.h"
+#include "devices.h"
+#include "metrics.h"
+#include "remote.h"
+#include "schedule.h"
+
+namespace Devices {
+
+namespace Pipeline {
+
+struct Settings {
+    // Where history is kept across restarts, empty to keep it in memory only
+    std::string history_path;
+    // How often history is written out while running
+    std::chrono::seconds history_interval{60};
+    // Print threshold range changes of analog devices to stdout
+    bool alarms = false;
+    // Unix socket to serve the devices on, empty for none
+    std::string socket_path;
+    // Localhost port to serve Prometheus metrics on, 0 for none
+    int metrics_port = 0;
+};
+
+// Threshold range an analog device's value is in, worst first
+enum class Level : uint8_t { Warning, Caution, Optimal, None };
+
+inline const char *level_to_string(Level level) {
+    switch (level) {
+    case Level::Warning:
+        return "warning";
+    case Level::Caution:
+        return "caution";
+    case Level::Optimal:
+        return "optimal";
+    default:
+        return "none";
+    }
+}
+
+// Where an analog device's current value is, None for digital devices
+Level level_of(const Device &device);
+
+// Every stage that keeps the devices going, independent of whether anything
+// is watching: sampling and derived values, recording to history, control
+// loops, the schedule, actuator writes, alarms, history persistence, serving
+// remote views and metrics, each on its own thread. A local view takes the
+// history lock to read the history and waits on changes() to know when to
+// redraw.
+//
+// History is saved as [magic][u32 version][u32 hist_size][u32 count] and then
+// per device [u16 name length][name][u8 type][u64 hist generation] and both
+// rings, in host byte order. It's written to a temporary file and renamed
+// over the old one, so a crash mid write keeps the previous save.
+class Runner {
+  public:
+    Runner(std::vector<std::unique_ptr<Device>> &devices,
+           std::vector<std::unique_ptr<Control::Loop>> &loops,
+           Schedule::Scheduler &scheduler, Actuators::Queue &queue,
+           const Settings &settings);
+    ~Runner();
+
+    // Loads the saved history and starts every stage. Threads started here
+    // inherit the caller's signal mask.
+    void start();
+    // Stops and joins every stage, then saves the history one last time
+    void stop();
+    // Saves the history now, safe to call from any thread while running
+    bool flush_history();
+    // Devices whose history start() found in the saved file
+    size_t restored() const { return _restored; }
+
+    std::vector<std::unique_ptr<Device>> &devices() { return _devices; }
+    Schedule::Scheduler &scheduler() { return _scheduler; }
+    Actuators::Queue &queue() { return _queue; }
+    // Held while recording, take it to read the history
+    std::mutex &hist_lock() { return _hist_lock; }
+    Changes &changes() { return _changes; }
+
+  private:
+    std::vector<std::unique_ptr<Device>> &_devices;
+    std::vector<std::unique_ptr<Control::Loop>> &_loops;
+    Schedule::Scheduler &_scheduler;
+    Actuators::Queue &_queue;
+    Settings _settings;
+    std::mutex _hist_lock;
+    Changes _changes;
+    size_t _restored = 0;
+
+    std::atomic<bool> _running{false};
+    std::vector<std::thread> _threads;
+    std::unique_ptr<Remote::Server> _server;
+    std::unique_ptr<Metrics::Exporter> _exporter;
+    // Wakes the persistence stage early on shutdown
+    std::mutex _stop_lock;
+    std::condition_variable _stopping;
+
+    // Last level per device, only touched by the recording stage
+    std::vector<Level> _levels;
+    bool _levels_valid = false;
+
+    // Serializes saves from the persistence stage and flush_history()
+    std::mutex _flush_lock;
+    std::string _history_buffer;
+
+    void update_values();
+    void record_to_hist();
+    void control();
+    void schedule();
+    void actuate();
+    void persist();
+
+    void check_alarms();
+    size_t load_history();
+};
+
+void from_toml(Settings &settings, const std::string &toml_path);
+
+} // namespace Pipeline
+
+} // namespace Devices
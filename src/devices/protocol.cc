@@ -0,0 +1,456 @@
+// std library headers
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Local headers
+#include "devices.h"
+#include "protocol.h"
+#include "varint.h"
+
+using namespace Devices;
+using namespace Devices::Protocol;
+
+// Appends one frame, filling in its length when done
+class Writer {
+  public:
+    Writer(std::string &out, Kind kind) : _out(out), _start(out.size()) {
+        put<uint32_t>(0);
+        put<uint8_t>(static_cast<uint8_t>(kind));
+    }
+    ~Writer() {
+        uint32_t length = _out.size() - _start - header_bytes;
+        std::memcpy(&_out[_start], &length, sizeof(length));
+    }
+
+    template <typename T> void put(T value) {
+        _out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+    void put_string(const std::string &value) {
+        size_t bytes = std::min<size_t>(value.size(), UINT16_MAX);
+        put<uint16_t>(bytes);
+        _out.append(value.data(), bytes);
+    }
+    void put_optional(const std::optional<std::string> &value) {
+        put<uint8_t>(value.has_value());
+        if (value.has_value()) {
+            put_string(value.value());
+        }
+    }
+    void put_ranges(const std::vector<std::pair<float, float>> &ranges) {
+        size_t count = std::min<size_t>(ranges.size(), UINT16_MAX);
+        put<uint16_t>(count);
+        for (size_t i = 0; i < count; i++) {
+            put<float>(ranges[i].first);
+            put<float>(ranges[i].second);
+        }
+    }
+    void put_varint(uint64_t value) { Varint::put(_out, value); }
+    void put_bytes(const void *data, size_t size) {
+        _out.append(static_cast<const char *>(data), size);
+    }
+
+  private:
+    std::string &_out;
+    size_t _start;
+};
+
+// Bounds checked reads, everything after the first failed one is zero
+class Reader {
+  public:
+    explicit Reader(const Frame &frame)
+        : _data(frame.payload), _size(frame.size) {}
+
+    bool ok() const { return _ok; }
+    // Every byte was read and none too many
+    bool done() const { return _ok && _offset == _size; }
+
+    template <typename T> T get() {
+        T value{};
+        get_bytes(&value, sizeof(T));
+        return value;
+    }
+    std::string get_string() {
+        uint16_t bytes = get<uint16_t>();
+        if (!take(bytes)) {
+            return {};
+        }
+        return std::string(_data + _offset - bytes, bytes);
+    }
+    std::optional<std::string> get_optional() {
+        if (get<uint8_t>() == 0) {
+            return std::nullopt;
+        }
+        return get_string();
+    }
+    std::vector<std::pair<float, float>> get_ranges() {
+        std::vector<std::pair<float, float>> ranges(get<uint16_t>());
+        for (auto &range : ranges) {
+            range.first = get<float>();
+            range.second = get<float>();
+        }
+        return ranges;
+    }
+    uint64_t get_varint() {
+        uint64_t value = 0;
+        _ok = _ok && Varint::get(_data, _size, _offset, value);
+        return _ok ? value : 0;
+    }
+    // A varint that has to be below limit, such as a count of devices
+    uint64_t get_varint(uint64_t limit) {
+        uint64_t value = get_varint();
+        _ok = _ok && value < limit;
+        return _ok ? value : 0;
+    }
+    void get_bytes(void *data, size_t size) {
+        if (take(size)) {
+            std::memcpy(data, _data + _offset - size, size);
+        }
+    }
+
+  private:
+    const char *_data;
+    size_t _size;
+    size_t _offset = 0;
+    bool _ok = true;
+
+    bool take(size_t size) {
+        _ok = _ok && size <= _size - _offset;
+        if (_ok) {
+            _offset += size;
+        }
+        return _ok;
+    }
+};
+
+bool Protocol::next_frame(const std::string &buffer, size_t &offset,
+                          Frame &frame, bool &error) {
+    error = false;
+    if (buffer.size() - offset < header_bytes) {
+        return false;
+    }
+    uint32_t length;
+    std::memcpy(&length, buffer.data() + offset, sizeof(length));
+    if (length < sizeof(uint8_t) || length > max_frame_bytes) {
+        error = true;
+        return false;
+    }
+    if (buffer.size() - offset - header_bytes < length) {
+        return false;
+    }
+    const char *data = buffer.data() + offset + header_bytes;
+    frame.kind = static_cast<Kind>(data[0]);
+    frame.payload = data + sizeof(uint8_t);
+    frame.size = length - sizeof(uint8_t);
+    offset += header_bytes + length;
+    return true;
+}
+
+void Protocol::encode_schema(
+    std::string &out, const std::vector<std::unique_ptr<Device>> &devices) {
+    Writer writer(out, Kind::Schema);
+    writer.put<uint32_t>(devices.size());
+    for (const auto &device : devices) {
+        writer.put_string(device->name);
+        writer.put<uint32_t>(device->pin);
+        writer.put<uint8_t>(static_cast<uint8_t>(device->type));
+        writer.put<uint8_t>(static_cast<uint8_t>(device->modality));
+        writer.put<uint8_t>(device->is_active_low.value_or(false));
+        writer.put_optional(device->units);
+        writer.put_optional(device->expression);
+        writer.put<uint32_t>(device->abs_min.value_or(0));
+        writer.put<uint32_t>(device->abs_max.value_or(0));
+        writer.put<float>(device->rel_min.value_or(0.0f));
+        writer.put<float>(device->rel_max.value_or(0.0f));
+        writer.put_ranges(device->warnings);
+        writer.put_ranges(device->cautions);
+        writer.put_ranges(device->optimals);
+    }
+}
+
+// The one value that matters for the device's type as 32 bits
+uint32_t word(const Device &device, float analog, int digital) {
+    return device.type == Type::Analog ? Varint::float_bits(analog)
+                                       : static_cast<uint32_t>(digital);
+}
+
+uint32_t value_word(const Device &device) {
+    return word(device, device.get_value_analog(), device.get_value_digital());
+}
+
+uint32_t sample_word(const Device &device, uint64_t sample) {
+    size_t slot = sample % Device::hist_size;
+    return word(device, device.get_value_analog_ring()[slot],
+                device.get_value_digital_ring()[slot]);
+}
+
+// Newest sample, or zero before the first
+uint32_t last_sample_word(const Device &device) {
+    uint64_t generation = device.hist_generation();
+    return generation == 0 ? 0 : sample_word(device, generation - 1);
+}
+
+uint64_t delta(uint32_t value, uint32_t previous) {
+    return Varint::zigzag(static_cast<int32_t>(value - previous));
+}
+
+uint32_t undelta(uint64_t delta, uint32_t previous) {
+    return previous + static_cast<uint32_t>(Varint::unzigzag(delta));
+}
+
+// Stores the word back into the device's current values
+void set_word(Device &device, uint32_t value) {
+    if (device.type == Type::Analog) {
+        device.set_values(Varint::bits_float(value),
+                          device.get_value_digital());
+    } else {
+        device.set_values(device.get_value_analog(),
+                          static_cast<int>(value));
+    }
+}
+
+void append_word(Device &device, uint32_t value) {
+    if (device.type == Type::Analog) {
+        device.append_hist(Varint::bits_float(value), 0);
+    } else {
+        device.append_hist(0.0f, static_cast<int>(value));
+    }
+}
+
+Encoder::Encoder(const std::vector<std::unique_ptr<Device>> &devices)
+    : _devices(devices), _values(devices.size()), _sent(devices.size()),
+      _last_sample(devices.size()) {
+    for (size_t i = 0; i < devices.size(); i++) {
+        _values[i] = value_word(*devices[i]);
+        _sent[i] = devices[i]->hist_generation();
+        _last_sample[i] = last_sample_word(*devices[i]);
+    }
+}
+
+bool Encoder::values(std::string &out, bool keyframe) {
+    _scratch.clear();
+    size_t count = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < _devices.size(); i++) {
+        uint32_t value = value_word(*_devices[i]);
+        if (value == _values[i]) {
+            continue;
+        }
+        Varint::put(_scratch, i - next);
+        Varint::put(_scratch, delta(value, _values[i]));
+        _values[i] = value;
+        next = i + 1;
+        count++;
+    }
+    if (keyframe) {
+        this->keyframe(out);
+        return true;
+    }
+    if (count == 0) {
+        return false;
+    }
+    Writer writer(out, Kind::Values);
+    writer.put_varint(count);
+    writer.put_bytes(_scratch.data(), _scratch.size());
+    return true;
+}
+
+void Encoder::keyframe(std::string &out) const {
+    Writer writer(out, Kind::Keyframe);
+    writer.put_varint(_devices.size());
+    for (uint32_t value : _values) {
+        writer.put_varint(delta(value, 0));
+    }
+}
+
+bool Encoder::samples(std::string &out) {
+    _scratch.clear();
+    size_t count = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < _devices.size(); i++) {
+        const Device &device = *_devices[i];
+        uint64_t generation = device.hist_generation();
+        if (generation == _sent[i]) {
+            continue;
+        }
+        // Anything older has been overwritten already
+        uint64_t first = std::max<uint64_t>(
+            _sent[i], generation - std::min<uint64_t>(generation,
+                                                      Device::hist_size));
+        Varint::put(_scratch, i - next);
+        Varint::put(_scratch, generation - first);
+        for (uint64_t sample = first; sample < generation; sample++) {
+            uint32_t value = sample_word(device, sample);
+            Varint::put(_scratch, delta(value, _last_sample[i]));
+            _last_sample[i] = value;
+        }
+        _sent[i] = generation;
+        next = i + 1;
+        count++;
+    }
+    if (count == 0) {
+        return false;
+    }
+    Writer writer(out, Kind::Samples);
+    writer.put_varint(count);
+    writer.put_bytes(_scratch.data(), _scratch.size());
+    return true;
+}
+
+void Encoder::history(std::string &out) const {
+    Writer writer(out, Kind::History);
+    writer.put_varint(_devices.size());
+    for (size_t i = 0; i < _devices.size(); i++) {
+        uint64_t generation = _sent[i];
+        uint64_t count = std::min<uint64_t>(generation, Device::hist_size);
+        writer.put_varint(generation);
+        writer.put_varint(count);
+        uint32_t previous = 0;
+        for (uint64_t sample = generation - count; sample < generation;
+             sample++) {
+            uint32_t value = sample_word(*_devices[i], sample);
+            writer.put_varint(delta(value, previous));
+            previous = value;
+        }
+    }
+}
+
+void Protocol::encode_command(std::string &out, uint32_t device,
+                              float value) {
+    Writer writer(out, Kind::Command);
+    writer.put_varint(device);
+    writer.put<float>(value);
+}
+
+bool Protocol::decode_schema(const Frame &frame,
+                             std::vector<std::unique_ptr<Device>> &devices) {
+    Reader reader(frame);
+    uint32_t count = reader.get<uint32_t>();
+    devices.clear();
+    for (uint32_t i = 0; i < count && reader.ok(); i++) {
+        std::string name = reader.get_string();
+        auto device = std::make_unique<Device>(name, reader.get<uint32_t>());
+        auto type = static_cast<Type>(reader.get<uint8_t>());
+        auto modality = static_cast<Modality>(reader.get<uint8_t>());
+        bool is_active_low = reader.get<uint8_t>() != 0;
+        auto units = reader.get_optional();
+        auto expression = reader.get_optional();
+        uint32_t abs_min = reader.get<uint32_t>();
+        uint32_t abs_max = reader.get<uint32_t>();
+        float rel_min = reader.get<float>();
+        float rel_max = reader.get<float>();
+        if (type == Type::Analog) {
+            device->to_analog(units, abs_min, abs_max, rel_min, rel_max);
+        } else {
+            device->to_digital(is_active_low);
+        }
+        device->modality = modality;
+        device->expression = expression;
+        device->warnings = reader.get_ranges();
+        device->cautions = reader.get_ranges();
+        device->optimals = reader.get_ranges();
+        device->config_changed();
+        devices.push_back(std::move(device));
+    }
+    return reader.done();
+}
+
+bool Protocol::decode_history(
+    const Frame &frame, const std::vector<std::unique_ptr<Device>> &devices) {
+    Reader reader(frame);
+    if (reader.get_varint() != devices.size()) {
+        return false;
+    }
+    std::vector<float> analog(Device::hist_size);
+    std::vector<int> digital(Device::hist_size);
+    for (auto &device : devices) {
+        uint64_t generation = reader.get_varint();
+        uint64_t count = reader.get_varint(Device::hist_size + 1);
+        if (!reader.ok() || count > generation) {
+            return false;
+        }
+        std::fill(analog.begin(), analog.end(), 0.0f);
+        std::fill(digital.begin(), digital.end(), 0);
+        uint32_t value = 0;
+        for (uint64_t sample = generation - count; sample < generation;
+             sample++) {
+            value = undelta(reader.get_varint(), value);
+            size_t slot = sample % Device::hist_size;
+            if (device->type == Type::Analog) {
+                analog[slot] = Varint::bits_float(value);
+            } else {
+                digital[slot] = static_cast<int>(value);
+            }
+        }
+        if (!reader.ok()) {
+            return false;
+        }
+        device->restore_hist(generation, analog.data(), digital.data());
+    }
+    return reader.done();
+}
+
+bool Protocol::decode_values(
+    const Frame &frame, const std::vector<std::unique_ptr<Device>> &devices) {
+    Reader reader(frame);
+    bool keyframe = frame.kind == Kind::Keyframe;
+    uint64_t count = reader.get_varint(devices.size() + 1);
+    if (keyframe && count != devices.size()) {
+        return false;
+    }
+    size_t next = 0;
+    for (uint64_t i = 0; i < count && reader.ok(); i++) {
+        // Keyframes list every device, so they leave out the gaps
+        size_t index =
+            keyframe ? next : next + reader.get_varint(devices.size() - next);
+        if (!reader.ok()) {
+            return false;
+        }
+        Device &device = *devices[index];
+        uint32_t previous = keyframe ? 0 : value_word(device);
+        uint32_t value = undelta(reader.get_varint(), previous);
+        if (reader.ok()) {
+            set_word(device, value);
+        }
+        next = index + 1;
+    }
+    return reader.done();
+}
+
+bool Protocol::decode_samples(
+    const Frame &frame, const std::vector<std::unique_ptr<Device>> &devices) {
+    Reader reader(frame);
+    uint64_t count = reader.get_varint(devices.size() + 1);
+    size_t next = 0;
+    for (uint64_t i = 0; i < count && reader.ok(); i++) {
+        size_t index = next + reader.get_varint(devices.size() - next);
+        uint64_t samples = reader.get_varint(Device::hist_size + 1);
+        if (!reader.ok()) {
+            return false;
+        }
+        Device &device = *devices[index];
+        uint32_t value = last_sample_word(device);
+        for (uint64_t sample = 0; sample < samples; sample++) {
+            value = undelta(reader.get_varint(), value);
+            if (!reader.ok()) {
+                return false;
+            }
+            append_word(device, value);
+        }
+        next = index + 1;
+    }
+    return reader.done();
+}
+
+bool Protocol::decode_command(const Frame &frame, uint32_t &device,
+                              float &value) {
+    Reader reader(frame);
+    device = reader.get_varint(UINT32_MAX);
+    value = reader.get<float>();
+    return reader.done();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// std library headers
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Local headers
+#include "devices.h"
+
+namespace Devices {
+
+namespace Protocol {
+
+// Every frame is [u32 length][u8 kind][payload] in host byte order, the
+// length covering the kind and payload. Only meant for a local socket.
+//
+// Schema     u32 count, per device name, pin, type, modality, active low,
+//            units, expression, absolute and relative range and thresholds
+// History    varint count, per device varint hist generation, varint n and
+//            the last n samples oldest first
+// Keyframe   varint count, every device's value
+// Values     varint count, per changed device varint index gap and value
+// Samples    varint count, per device with new samples varint index gap,
+//            varint n and the n samples
+// Command    varint device, f32 value in relative units
+//
+// Only the value matching the device type goes out, the float bits of the
+// normalized analog value or the digital value. Each is the zigzag varint of
+// its difference from the one before: the previous value sent, the previous
+// sample, or zero at the start of a keyframe or history. Index gaps count the
+// devices skipped since the last one listed.
+//
+// A client gets Schema, History and a Keyframe once, then Values whenever
+// something changed, Samples whenever something was recorded and every so
+// often a Keyframe instead of Values. Clients only send Command.
+enum class Kind : uint8_t {
+    Schema = 1,
+    History = 2,
+    Values = 3,
+    Samples = 4,
+    Command = 5,
+    Keyframe = 6
+};
+
+const size_t header_bytes = sizeof(uint32_t);
+// Anything longer is garbage rather than a frame
+const size_t max_frame_bytes = 64 * 1024 * 1024;
+
+struct Frame {
+    Kind kind;
+    const char *payload;
+    size_t size;
+};
+
+// Takes the frame starting at offset off the buffer and moves offset past
+// it. False when the frame isn't complete yet or, setting error, when it
+// can't be a frame at all.
+bool next_frame(const std::string &buffer, size_t &offset, Frame &frame,
+                bool &error);
+
+// Everything the clients have been sent, so only what changed goes out.
+// Clients joining later catch up with history() and keyframe(), which
+// describe the same state as the stream so far. Encoders append one whole
+// frame to out.
+class Encoder {
+  public:
+    // Starts from the current history, so the caller holds the history lock
+    explicit Encoder(const std::vector<std::unique_ptr<Device>> &devices);
+
+    // Values changed since the last call, all of them as a keyframe if asked
+    // to. False if nothing changed and no keyframe was asked for.
+    bool values(std::string &out, bool keyframe);
+    // Every value as of the last values() call
+    void keyframe(std::string &out) const;
+    // Samples recorded since the last call, false if there were none. Reads
+    // the history, so the caller holds the history lock.
+    bool samples(std::string &out);
+    // The history as of the last samples() call. Reads the history, so the
+    // caller holds the history lock.
+    void history(std::string &out) const;
+
+  private:
+    const std::vector<std::unique_ptr<Device>> &_devices;
+    std::vector<uint32_t> _values;
+    std::vector<uint64_t> _sent;
+    std::vector<uint32_t> _last_sample;
+    // Entries are written here first since their count leads the frame
+    std::string _scratch;
+};
+
+void encode_schema(std::string &out,
+                   const std::vector<std::unique_ptr<Device>> &devices);
+void encode_command(std::string &out, uint32_t device, float value);
+
+// Decoders return false on a malformed payload or one that doesn't match the
+// devices. Only decode_schema creates devices, the rest update them.
+bool decode_schema(const Frame &frame,
+                   std::vector<std::unique_ptr<Device>> &devices);
+bool decode_history(const Frame &frame,
+                    const std::vector<std::unique_ptr<Device>> &devices);
+// Values and keyframes
+bool decode_values(const Frame &frame,
+                   const std::vector<std::unique_ptr<Device>> &devices);
+// Writes the history, so the caller holds the history lock
+bool decode_samples(const Frame &frame,
+                    const std::vector<std::unique_ptr<Device>> &devices);
+bool decode_command(const Frame &frame, uint32_t &device, float &value);
+
+} // namespace Protocol
+
+} // namespace Devices
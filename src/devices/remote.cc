@@ -0,0 +1,427 @@
+// std library headers
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// POSIX headers
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "protocol.h"
+#include "remote.h"
+#include "schedule.h"
+#include "trace.h"
+
+using namespace Devices;
+using namespace Devices::Remote;
+
+// Same rate the values are sampled at
+const std::chrono::milliseconds tick{50};
+// Every value goes out every so often, whether it changed or not
+const uint64_t keyframe_ticks = 100;
+// Clients this far behind are dropped rather than buffered for
+const size_t max_backlog_bytes = Protocol::max_frame_bytes;
+
+bool socket_address(const std::string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+    return true;
+}
+
+// Clears the path for bind, but only of a socket nobody listens on anymore.
+// A regular file, or a socket another server is still serving, is left
+// alone and false returned.
+bool remove_stale_socket(const std::string &path,
+                         const sockaddr_un &address) {
+    struct stat status;
+    if (::lstat(path.c_str(), &status) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(status.st_mode)) {
+        std::cerr << "Not serving on " << path << ": not a socket"
+                  << std::endl;
+        return false;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool stale = ::connect(fd, reinterpret_cast<const sockaddr *>(&address),
+                           sizeof(address)) != 0 &&
+                 errno == ECONNREFUSED;
+    ::close(fd);
+    if (!stale) {
+        std::cerr << "Not serving on " << path
+                  << ": another server is using it" << std::endl;
+        return false;
+    }
+    return ::unlink(path.c_str()) == 0;
+}
+
+// Appends everything readable right now, false once the peer is gone
+bool read_available(int fd, std::string &in) {
+    char chunk[16384];
+    while (true) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n > 0) {
+            in.append(chunk, n);
+        } else if (n == 0) {
+            return false;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+    }
+}
+
+Server::Server(const std::vector<std::unique_ptr<Device>> &devices,
+               std::mutex &hist_lock, Changes &changes,
+               Actuators::Queue &queue, std::string path)
+    : _devices(devices), _hist_lock(hist_lock), _changes(changes),
+      _queue(queue), _path(std::move(path)) {}
+
+Server::~Server() { stop(); }
+
+bool Server::start() {
+    sockaddr_un address;
+    if (!socket_address(_path, address)) {
+        return false;
+    }
+    if (!remove_stale_socket(_path, address)) {
+        return false;
+    }
+    _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd < 0 ||
+        ::bind(_fd, reinterpret_cast<sockaddr *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(_fd, 16) != 0) {
+        std::cerr << "Failed to listen on " << _path << ": "
+                  << std::strerror(errno) << std::endl;
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+        return false;
+    }
+    _running = true;
+    _thread = std::thread([this] { serve(); });
+    return true;
+}
+
+void Server::stop() {
+    if (!_running.exchange(false)) {
+        return;
+    }
+    _thread.join();
+    ::close(_fd);
+    _fd = -1;
+    ::unlink(_path.c_str());
+}
+
+void Server::serve() {
+    TRACE_THREAD("serve");
+    std::vector<Client> clients;
+    // Clients accepted since the last tick, they get the schema, history and
+    // a keyframe before anything else
+    std::vector<Client> joining;
+    std::vector<pollfd> fds;
+    std::unique_ptr<Protocol::Encoder> encoder;
+    {
+        const std::lock_guard<std::mutex> lg(_hist_lock);
+        encoder = std::make_unique<Protocol::Encoder>(_devices);
+    }
+    uint64_t ticks = 0;
+    std::string schema;
+    Protocol::encode_schema(schema, _devices);
+    std::string update;
+    uint64_t seen = _changes.generation();
+    auto next_tick = std::chrono::steady_clock::now();
+
+    while (_running) {
+        fds.clear();
+        fds.push_back({_fd, POLLIN, 0});
+        for (const auto &client : clients) {
+            short events = POLLIN;
+            if (client.out_offset < client.out.size()) {
+                events |= POLLOUT;
+            }
+            fds.push_back({client.fd, events, 0});
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+            next_tick - std::chrono::steady_clock::now());
+        ::poll(fds.data(), fds.size(),
+               std::max<int>(0, std::min<int64_t>(wait.count(), 50)));
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = ::accept4(_fd, nullptr, nullptr,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                joining.push_back({fd, {}, {}, 0});
+            }
+        }
+
+        // Only commands come this way
+        for (size_t i = 0; i < clients.size(); i++) {
+            Client &client = clients[i];
+            short revents = fds[i + 1].revents;
+            bool alive = !(revents & (POLLERR | POLLHUP | POLLNVAL)) ||
+                         (revents & POLLIN);
+            if (alive && (revents & POLLIN)) {
+                alive = read_available(client.fd, client.in);
+                size_t offset = 0;
+                Protocol::Frame frame;
+                bool error = false;
+                while (alive && Protocol::next_frame(client.in, offset, frame,
+                                                     error)) {
+                    uint32_t device;
+                    float value;
+                    alive = frame.kind == Protocol::Kind::Command &&
+                            Protocol::decode_command(frame, device, value) &&
+                            device < _devices.size();
+                    // Only actuators take commands, sensors and derived
+                    // values can't be overwritten from outside
+                    if (alive &&
+                        _devices[device]->modality == Modality::InOut &&
+                        std::isfinite(value)) {
+                        _devices[device]->drive();
+                        _queue.submit(device, value,
+                                      Actuators::Source::Remote);
+                    }
+                }
+                alive = alive && !error;
+                client.in.erase(0, offset);
+            }
+            if (!alive) {
+                ::close(client.fd);
+                client.fd = -1;
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= next_tick) {
+            TRACE_SPAN("serve tick");
+            next_tick += tick;
+            // Don't try to catch up on ticks missed while suspended
+            next_tick = std::max(next_tick, std::chrono::steady_clock::now());
+            update.clear();
+            uint64_t generation = _changes.generation();
+            bool keyframe = ++ticks % keyframe_ticks == 0;
+            if (generation != seen || keyframe) {
+                seen = generation;
+                encoder->values(update, keyframe);
+            }
+            {
+                const std::lock_guard<std::mutex> lg(_hist_lock);
+                encoder->samples(update);
+                // The history is taken right after the samples, so it ends
+                // where the next samples start
+                for (auto &client : joining) {
+                    client.out = schema;
+                    encoder->history(client.out);
+                    encoder->keyframe(client.out);
+                }
+            }
+            for (auto &client : clients) {
+                if (client.fd >= 0) {
+                    client.out += update;
+                }
+            }
+            for (auto &client : joining) {
+                clients.push_back(std::move(client));
+            }
+            joining.clear();
+        }
+
+        for (auto &client : clients) {
+            while (client.fd >= 0 && client.out_offset < client.out.size()) {
+                ssize_t n = ::send(client.fd, client.out.data() +
+                                                  client.out_offset,
+                                   client.out.size() - client.out_offset,
+                                   MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (n > 0) {
+                    client.out_offset += n;
+                } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                           errno != EINTR) {
+                    ::close(client.fd);
+                    client.fd = -1;
+                } else {
+                    break;
+                }
+            }
+            if (client.fd < 0) {
+                continue;
+            }
+            if (client.out_offset == client.out.size()) {
+                client.out.clear();
+                client.out_offset = 0;
+            } else if (client.out.size() - client.out_offset >
+                       max_backlog_bytes) {
+                std::cerr << "Dropping a client too slow to keep up"
+                          << std::endl;
+                ::close(client.fd);
+                client.fd = -1;
+            }
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                     [](const Client &client) {
+                                         return client.fd < 0;
+                                     }),
+                      clients.end());
+        _client_count = clients.size();
+    }
+    for (auto &client : clients) {
+        ::close(client.fd);
+    }
+    for (auto &client : joining) {
+        ::close(client.fd);
+    }
+}
+
+void RemoteBackend::write(const std::vector<Actuators::Write> &batch) {
+    for (const auto &write : batch) {
+        Protocol::encode_command(_pending, write.device, write.value);
+    }
+}
+
+Client::Client(std::string path) : _path(std::move(path)) {}
+
+Client::~Client() {
+    stop();
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+bool Client::connect() {
+    sockaddr_un address;
+    if (!socket_address(_path, address)) {
+        return false;
+    }
+    _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0 || ::connect(_fd, reinterpret_cast<sockaddr *>(&address),
+                             sizeof(address)) != 0) {
+        std::cerr << "Failed to connect to " << _path << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    _connected = true;
+    // The server sends the schema and history on its next tick
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!_queue && std::chrono::steady_clock::now() < deadline) {
+        if (!receive(true)) {
+            break;
+        }
+    }
+    if (!_queue) {
+        std::cerr << "No devices received from " << _path << std::endl;
+        _connected = false;
+        return false;
+    }
+    return true;
+}
+
+void Client::start() {
+    if (!_connected || _running.exchange(true)) {
+        return;
+    }
+    _thread = std::thread([this] { follow(); });
+}
+
+void Client::stop() {
+    if (!_running.exchange(false)) {
+        return;
+    }
+    _thread.join();
+}
+
+void Client::follow() {
+    TRACE_THREAD("follow");
+    while (_running && _connected) {
+        bool ok = receive(true);
+        _queue->flush(Actuators::Clock::now());
+        std::string &pending = _backend.pending();
+        size_t written = 0;
+        while (ok && written < pending.size()) {
+            ssize_t n = ::send(_fd, pending.data() + written,
+                               pending.size() - written, MSG_NOSIGNAL);
+            ok = n > 0 || (n < 0 && errno == EINTR);
+            written += std::max<ssize_t>(n, 0);
+        }
+        pending.clear();
+        if (!ok) {
+            _connected = false;
+        }
+        _changes.publish();
+    }
+}
+
+bool Client::receive(bool wait) {
+    pollfd fd = {_fd, POLLIN, 0};
+    if (::poll(&fd, 1, wait ? tick.count() : 0) <= 0) {
+        return true;
+    }
+    bool ok = read_available(_fd, _in);
+    size_t offset = 0;
+    Protocol::Frame frame;
+    bool error = false;
+    while (ok && Protocol::next_frame(_in, offset, frame, error)) {
+        switch (frame.kind) {
+        case Protocol::Kind::Schema:
+            // Devices are only created once, the views hold on to them
+            ok = _devices.empty() && Protocol::decode_schema(frame, _devices);
+            for (auto &device : _devices) {
+                device->watch(&_changes);
+            }
+            break;
+        case Protocol::Kind::History: {
+            const std::lock_guard<std::mutex> lg(_hist_lock);
+            ok = Protocol::decode_history(frame, _devices);
+            if (ok && !_queue) {
+                _queue = std::make_unique<Actuators::Queue>(_devices,
+                                                            _backend);
+                _scheduler = std::make_unique<Schedule::Scheduler>(
+                    _jobs, *_queue, "");
+            }
+            break;
+        }
+        case Protocol::Kind::Values:
+        case Protocol::Kind::Keyframe:
+            ok = Protocol::decode_values(frame, _devices);
+            break;
+        case Protocol::Kind::Samples: {
+            TRACE_SPAN("append samples");
+            const std::lock_guard<std::mutex> lg(_hist_lock);
+            ok = Protocol::decode_samples(frame, _devices);
+            break;
+        }
+        default:
+            ok = false;
+            break;
+        }
+    }
+    _in.erase(0, offset);
+    if (!ok || error) {
+        _connected = false;
+        return false;
+    }
+    return true;
+}
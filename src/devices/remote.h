@@ -0,0 +1,117 @@
+#pragma once
+
+// std library headers
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "schedule.h"
+
+namespace Devices {
+
+namespace Remote {
+
+// Serves a pipeline's devices over a Unix domain socket, see Protocol for
+// what goes over it. One thread polls the listening socket and every client,
+// encodes each update once and queues it for every client, so a slow client
+// only costs memory until it's dropped. Commands from clients go to the
+// actuator queue like the UI's, as Source::Remote, and only for InOut
+// devices with a finite value.
+class Server {
+  public:
+    Server(const std::vector<std::unique_ptr<Device>> &devices,
+           std::mutex &hist_lock, Changes &changes, Actuators::Queue &queue,
+           std::string path);
+    ~Server();
+
+    // Replaces a stale socket left at the path, fails if anything else is
+    // there, a live socket included
+    bool start();
+    void stop();
+    size_t clients() const { return _client_count.load(); }
+
+  private:
+    struct Client {
+        int fd;
+        std::string in;
+        std::string out;
+        size_t out_offset = 0;
+    };
+
+    const std::vector<std::unique_ptr<Device>> &_devices;
+    std::mutex &_hist_lock;
+    Changes &_changes;
+    Actuators::Queue &_queue;
+    std::string _path;
+    int _fd = -1;
+    std::atomic<bool> _running{false};
+    std::atomic<size_t> _client_count{0};
+    std::thread _thread;
+
+    void serve();
+};
+
+// Sends actuator writes to a server's queue instead of the hardware
+class RemoteBackend : public Actuators::Backend {
+  public:
+    void write(const std::vector<Actuators::Write> &batch) override;
+    // Commands written since the last call
+    std::string &pending() { return _pending; }
+
+  private:
+    std::string _pending;
+};
+
+// The other end of a Server. Mirrors its devices and history locally so the
+// views can read them as usual, and forwards actuator commands through a
+// local queue, so the usual limits hold before anything goes out.
+class Client {
+  public:
+    explicit Client(std::string path);
+    ~Client();
+
+    // Connects and waits for the schema and history
+    bool connect();
+    // Follows the server until stop() or until it goes away
+    void start();
+    void stop();
+    bool connected() const { return _connected.load(); }
+
+    std::vector<std::unique_ptr<Device>> &devices() { return _devices; }
+    Schedule::Scheduler &scheduler() { return *_scheduler; }
+    Actuators::Queue &queue() { return *_queue; }
+    std::mutex &hist_lock() { return _hist_lock; }
+    Changes &changes() { return _changes; }
+
+  private:
+    std::string _path;
+    int _fd = -1;
+    std::string _in;
+    std::vector<std::unique_ptr<Device>> _devices;
+    // Schedules stay with the server, this one is always empty
+    std::vector<std::unique_ptr<Schedule::Job>> _jobs;
+    RemoteBackend _backend;
+    std::unique_ptr<Actuators::Queue> _queue;
+    std::unique_ptr<Schedule::Scheduler> _scheduler;
+    std::mutex _hist_lock;
+    Changes _changes;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _connected{false};
+    std::thread _thread;
+
+    void follow();
+    // Reads whatever arrived and applies every whole frame, false once the
+    // connection is gone or the stream is broken
+    bool receive(bool wait);
+};
+
+} // namespace Remote
+
+} // namespace Devices
@@ -0,0 +1,514 @@
+// std library headers
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 3rd party headers
+// ---- tomlplusplus ----
+#include <toml++/toml.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+#include "events.h"
+#include "schedule.h"
+
+using namespace Devices;
+using namespace Devices::Schedule;
+
+// Parses one cron field into bits [min, max], offset so bit 0 is min
+template <size_t N>
+bool parse_field(const std::string &field, int min, int max,
+                 std::bitset<N> &bits) {
+    std::stringstream items(field);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        int step = 1;
+        size_t slash = item.find('/');
+        if (slash != std::string::npos) {
+            step = std::atoi(item.c_str() + slash + 1);
+            item = item.substr(0, slash);
+            if (step <= 0) {
+                return false;
+            }
+        }
+        int first = min;
+        int last = max;
+        if (item != "*") {
+            size_t dash = item.find('-');
+            first = std::atoi(item.c_str());
+            last = (dash != std::string::npos)
+                       ? std::atoi(item.c_str() + dash + 1)
+                       : (slash != std::string::npos ? max : first);
+        }
+        if (first < min || last > max || first > last) {
+            return false;
+        }
+        for (int value = first; value <= last; value += step) {
+            bits.set((value - min) % N);
+        }
+    }
+    return true;
+}
+
+std::optional<Cron> Cron::parse(const std::string &rule) {
+    std::stringstream fields(rule);
+    std::string minutes, hours, days, months, weekdays;
+    if (!(fields >> minutes >> hours >> days >> months >> weekdays)) {
+        return std::nullopt;
+    }
+    Cron cron;
+    // Day of week 7 is also Sunday, which wraps to bit 0
+    if (!parse_field(minutes, 0, 59, cron._minutes) ||
+        !parse_field(hours, 0, 23, cron._hours) ||
+        !parse_field(days, 1, 31, cron._days) ||
+        !parse_field(months, 1, 12, cron._months) ||
+        !parse_field(weekdays, 0, 7, cron._weekdays)) {
+        return std::nullopt;
+    }
+    cron._any_day = (days == "*");
+    cron._any_weekday = (weekdays == "*");
+    return cron;
+}
+
+bool Cron::matches_day(const std::tm &tm) const {
+    bool day = _days[tm.tm_mday - 1];
+    bool weekday = _weekdays[tm.tm_wday];
+    // Like cron, restricting both fields matches either of them
+    if (_any_day || _any_weekday) {
+        return day && weekday;
+    }
+    return day || weekday;
+}
+
+// Re-normalizes a broken down local time after a field was bumped
+void normalize(std::tm &tm) {
+    tm.tm_isdst = -1;
+    std::time_t time = std::mktime(&tm);
+    localtime_r(&time, &tm);
+}
+
+std::time_t Cron::next(std::time_t after) const {
+    std::time_t start = after + 60 - (after % 60);
+    std::tm tm;
+    localtime_r(&start, &tm);
+    tm.tm_sec = 0;
+    // Skips whole months, days and hours at a time, so even sparse rules
+    // resolve within a few hundred iterations
+    for (int i = 0; i < 4096; i++) {
+        if (!_months[tm.tm_mon]) {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!matches_day(tm)) {
+            tm.tm_mday++;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!_hours[tm.tm_hour]) {
+            tm.tm_hour++;
+            tm.tm_min = 0;
+        } else if (!_minutes[tm.tm_min]) {
+            tm.tm_min++;
+        } else {
+            tm.tm_isdst = -1;
+            return std::mktime(&tm);
+        }
+        normalize(tm);
+    }
+    return -1;
+}
+
+std::optional<Blackout> Blackout::parse(const std::string &window) {
+    int begin_h, begin_m, end_h, end_m;
+    if (std::sscanf(window.c_str(), "%d:%d-%d:%d", &begin_h, &begin_m, &end_h,
+                    &end_m) != 4) {
+        return std::nullopt;
+    }
+    return Blackout{begin_h * 60 + begin_m, end_h * 60 + end_m};
+}
+
+bool Blackout::contains(std::time_t time) const {
+    std::tm tm;
+    localtime_r(&time, &tm);
+    int minute = tm.tm_hour * 60 + tm.tm_min;
+    if (begin <= end) {
+        return minute >= begin && minute < end;
+    }
+    return minute >= begin || minute < end;
+}
+
+bool Job::in_blackout(std::time_t time) const {
+    return std::any_of(
+        blackouts.begin(), blackouts.end(),
+        [time](const Blackout &blackout) { return blackout.contains(time); });
+}
+
+std::time_t Job::next_after(std::time_t after) const {
+    if (!cron.has_value()) {
+        // One-shots landing in a blackout are pushed back to its end
+        if (!at.has_value() || at.value() <= after) {
+            return -1;
+        }
+        std::time_t start = at.value();
+        for (int i = 0; i < 24 * 60 && in_blackout(start); i++) {
+            start += 60;
+        }
+        return start;
+    }
+    // Recurring occurrences landing in a blackout are skipped
+    std::time_t start = cron->next(after);
+    for (int i = 0; i < 1024 && start >= 0 && in_blackout(start); i++) {
+        start = cron->next(start);
+    }
+    return start;
+}
+
+TimingWheel::TimingWheel(int64_t now) : _now(now) {
+    for (auto &level : _wheel) {
+        level.fill(none);
+    }
+}
+
+void TimingWheel::resize(size_t timers) { _timers.resize(timers); }
+
+bool TimingWheel::is_scheduled(uint32_t timer) const {
+    return _timers[timer].scheduled;
+}
+
+void TimingWheel::schedule(uint32_t timer, int64_t expires) {
+    cancel(timer);
+    _timers[timer].expires = expires;
+    insert(timer);
+}
+
+void TimingWheel::insert(uint32_t timer) {
+    auto &t = _timers[timer];
+    int64_t delta = t.expires - _now;
+    int64_t slot_time = t.expires;
+    int level = 0;
+    if (delta < 0) {
+        slot_time = _now;
+    } else {
+        // Beyond the last level, park at its far edge and re-insert later
+        int64_t span = int64_t(1) << (slot_bits * levels);
+        if (delta >= span) {
+            slot_time = _now + span - 1;
+            delta = span - 1;
+        }
+        while (level < levels - 1 &&
+               delta >= (int64_t(1) << (slot_bits * (level + 1)))) {
+            level++;
+        }
+    }
+    t.level = level;
+    t.slot = (slot_time >> (slot_bits * level)) & (slots - 1);
+    uint32_t &head = _wheel[level][t.slot];
+    t.prev = none;
+    t.next = head;
+    if (head != none) {
+        _timers[head].prev = timer;
+    }
+    head = timer;
+    t.scheduled = true;
+    _pending++;
+}
+
+void TimingWheel::cancel(uint32_t timer) {
+    auto &t = _timers[timer];
+    if (!t.scheduled) {
+        return;
+    }
+    if (t.prev != none) {
+        _timers[t.prev].next = t.next;
+    } else {
+        _wheel[t.level][t.slot] = t.next;
+    }
+    if (t.next != none) {
+        _timers[t.next].prev = t.prev;
+    }
+    t.next = none;
+    t.prev = none;
+    t.scheduled = false;
+    _pending--;
+}
+
+uint32_t TimingWheel::detach(uint32_t &head) {
+    uint32_t list = head;
+    head = none;
+    return list;
+}
+
+void TimingWheel::cascade(int level, int index) {
+    uint32_t timer = detach(_wheel[level][index]);
+    while (timer != none) {
+        uint32_t next = _timers[timer].next;
+        _pending--;
+        insert(timer);
+        timer = next;
+    }
+}
+
+Scheduler::Scheduler(std::vector<std::unique_ptr<Job>> &jobs,
+                     Actuators::Queue &queue, std::string state_file)
+    : _jobs(jobs), _queue(queue), _state_file(state_file),
+      _wheel(std::time(nullptr)) {
+    _wheel.resize(_jobs.size());
+    load_state(std::time(nullptr));
+    for (uint32_t i = 0; i < _jobs.size(); i++) {
+        arm(i);
+    }
+}
+
+// Schedules the job's next transition, whether that's a start or a stop
+void Scheduler::arm(uint32_t job) {
+    auto &j = *_jobs[job];
+    if (j.running_until >= 0) {
+        _wheel.schedule(job, j.running_until);
+    } else if (j.next_start >= 0) {
+        _wheel.schedule(job, j.next_start);
+    } else {
+        _wheel.cancel(job);
+    }
+}
+
+void Scheduler::fire(uint32_t job, std::time_t now) {
+    auto &j = *_jobs[job];
+    if (j.running_until >= 0) {
+        _queue.submit(j.actuator, j.off_value, Actuators::Source::Schedule);
+        j.running_until = -1;
+        j.next_start = j.next_after(now);
+    } else {
+        _queue.submit(j.actuator, j.value, Actuators::Source::Schedule);
+        if (j.duration_s > 0) {
+            j.running_until = j.next_start + j.duration_s;
+        }
+        j.next_start = j.next_after(std::max(now, j.next_start));
+    }
+    arm(job);
+    _generation++;
+}
+
+void Scheduler::advance(std::time_t now) {
+    const std::lock_guard<std::mutex> lg(_lock);
+    uint64_t generation = _generation;
+    _wheel.advance(now, [this, now](uint32_t job) { fire(job, now); });
+    if (generation != _generation) {
+        save_state();
+    }
+}
+
+std::vector<Entry> Scheduler::upcoming(std::time_t now, size_t count) {
+    const std::lock_guard<std::mutex> lg(_lock);
+    std::time_t minute = now / 60;
+    if (_cached_generation == _generation && _cached_minute == minute &&
+        count <= _cached_count) {
+        if (_cached.size() > count) {
+            return std::vector<Entry>(_cached.begin(),
+                                      _cached.begin() + count);
+        }
+        return _cached;
+    }
+    _cached.clear();
+    using Start = std::pair<std::time_t, size_t>;
+    std::priority_queue<Start, std::vector<Start>, std::greater<Start>> starts;
+    for (size_t i = 0; i < _jobs.size(); i++) {
+        const auto &job = *_jobs[i];
+        if (job.running_until >= 0 && _cached.size() < count) {
+            _cached.push_back({job.running_until - job.duration_s,
+                               job.running_until, i, true});
+        }
+        if (job.next_start >= 0) {
+            starts.push({job.next_start, i});
+        }
+    }
+    // Only expand as many occurrences as there are rows to show
+    while (_cached.size() < count && !starts.empty()) {
+        auto [start, i] = starts.top();
+        starts.pop();
+        const auto &job = *_jobs[i];
+        _cached.push_back({start,
+                           job.duration_s > 0 ? start + job.duration_s : -1,
+                           i, false});
+        std::time_t next = job.next_after(start);
+        if (next >= 0) {
+            starts.push({next, i});
+        }
+    }
+    _cached_generation = _generation;
+    _cached_minute = minute;
+    _cached_count = count;
+    return _cached;
+}
+
+void Scheduler::load_state(std::time_t now) {
+    std::map<std::string, std::pair<std::time_t, std::time_t>> saved;
+    std::ifstream in(_state_file);
+    std::string name;
+    std::time_t next_start, running_until;
+    while (in >> std::quoted(name) >> next_start >> running_until) {
+        saved[name] = {next_start, running_until};
+    }
+    for (auto &job : _jobs) {
+        auto it = saved.find(job->name);
+        if (it != saved.end() && it->second.second > now) {
+            // Interrupted mid-run, pick up where we left off
+            job->running_until = it->second.second;
+            _queue.submit(job->actuator, job->value,
+                          Actuators::Source::Schedule);
+        }
+        if (it != saved.end() && !job->cron.has_value() &&
+            it->second.first < 0) {
+            // One-shot that already ran
+            job->next_start = -1;
+        } else {
+            job->next_start = job->next_after(now);
+        }
+    }
+}
+
+void Scheduler::save_state() const {
+    if (_state_file.empty()) {
+        return;
+    }
+    // Write then rename so a crash never leaves a half written file
+    std::string temp = _state_file + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        for (const auto &job : _jobs) {
+            out << std::quoted(job->name) << " " << job->next_start << " "
+                << job->running_until << "\n";
+        }
+        if (!out) {
+            std::cerr << "Failed to save schedule state to " << temp
+                      << std::endl;
+            return;
+        }
+    }
+    std::rename(temp.c_str(), _state_file.c_str());
+}
+
+// Parses "YYYY-MM-DD HH:MM" in local time
+std::optional<std::time_t> parse_time(const std::string &str) {
+    std::tm tm{};
+    std::istringstream iss(str);
+    iss >> std::get_time(&tm, "%Y-%m-%d %H:%M");
+    if (iss.fail()) {
+        return std::nullopt;
+    }
+    tm.tm_isdst = -1;
+    return std::mktime(&tm);
+}
+
+void parse_blackouts(const toml::array *windows,
+                     std::vector<Blackout> &blackouts,
+                     const std::string &owner) {
+    if (windows == nullptr) {
+        return;
+    }
+    for (auto &&window : *windows) {
+        auto str = window.value<std::string>();
+        auto blackout = str ? Blackout::parse(str.value()) : std::nullopt;
+        if (blackout.has_value()) {
+            blackouts.push_back(blackout.value());
+        } else {
+            std::cerr << "Ignoring bad blackout window for " << owner
+                      << std::endl;
+        }
+    }
+}
+
+void Schedule::from_toml(std::vector<std::unique_ptr<Job>> &jobs,
+                         std::string &state_file,
+                         std::vector<std::unique_ptr<Device>> &devices,
+                         const std::string &toml_path) {
+    try {
+        auto config = toml::parse_file(toml_path);
+        auto schedules = config["Schedules"];
+        state_file = schedules["state_file"].value_or<std::string>("");
+
+        std::vector<Blackout> blackouts;
+        parse_blackouts(schedules["blackouts"].as_array(), blackouts,
+                        "all jobs");
+
+        if (!schedules["Jobs"].is_array_of_tables()) {
+            return;
+        }
+        // Controllers loaded before the jobs already drive these
+        std::vector<bool> controlled(devices.size());
+        for (size_t i = 0; i < devices.size(); i++) {
+            controlled[i] = devices[i]->is_driven();
+        }
+        for (auto &&entry : *schedules["Jobs"].as_array()) {
+            auto &j_table = *entry.as_table();
+            std::string name = j_table["name"].value<std::string>().value();
+            std::string actuator =
+                j_table["actuator"].value<std::string>().value();
+            auto it = std::find_if(
+                devices.begin(), devices.end(),
+                [&](const auto &device) { return device->name == actuator; });
+            if (it == devices.end() || (*it)->modality != Modality::InOut) {
+                std::cerr << "Skipping job " << name << ": " << actuator
+                          << " is not an InOut device" << std::endl;
+                continue;
+            }
+            // The controller would undo the job within one period
+            if (controlled[it - devices.begin()]) {
+                std::cerr << "Skipping job " << name << ": " << actuator
+                          << " is already driven by a controller"
+                          << std::endl;
+                continue;
+            }
+
+            auto job = std::make_unique<Job>(name);
+            job->actuator = it - devices.begin();
+            if (j_table["cron"]) {
+                job->cron =
+                    Cron::parse(j_table["cron"].value<std::string>().value());
+                if (!job->cron.has_value()) {
+                    std::cerr << "Skipping job " << name << ": bad cron rule"
+                              << std::endl;
+                    continue;
+                }
+            } else {
+                job->at =
+                    parse_time(j_table["at"].value<std::string>().value());
+                if (!job->at.has_value()) {
+                    std::cerr << "Skipping job " << name
+                              << ": bad start time, expected YYYY-MM-DD HH:MM"
+                              << std::endl;
+                    continue;
+                }
+            }
+            job->duration_s = j_table["duration_s"].value_or<int64_t>(0);
+            // Default to switching digital actuators on and back off
+            const auto &device = **it;
+            float high = (device.type == Type::Analog) ? device.rel_max.value()
+                                                       : 1.0f;
+            float low = (device.type == Type::Analog) ? device.rel_min.value()
+                                                      : 0.0f;
+            job->value = j_table["value"].value_or(high);
+            job->off_value = j_table["off_value"].value_or(low);
+            job->blackouts = blackouts;
+            parse_blackouts(j_table["blackouts"].as_array(), job->blackouts,
+                            name);
+            (*it)->drive();
+            jobs.push_back(std::move(job));
+        }
+    } catch (const toml::parse_error &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    } catch (const std::bad_optional_access &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+// std library headers
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+
+namespace Devices {
+
+namespace Schedule {
+
+// Cron-like rule in local time: "minute hour day-of-month month day-of-week",
+// each field a comma separated list of *, n or n-m with an optional /step
+class Cron {
+  public:
+    // Returns std::nullopt if the rule can't be parsed
+    static std::optional<Cron> parse(const std::string &rule);
+
+    // First matching minute strictly after the given time, -1 if none
+    std::time_t next(std::time_t after) const;
+
+  private:
+    std::bitset<60> _minutes;
+    std::bitset<24> _hours;
+    std::bitset<32> _days;
+    std::bitset<12> _months;
+    std::bitset<7> _weekdays;
+    bool _any_day = false;
+    bool _any_weekday = false;
+
+    bool matches_day(const std::tm &tm) const;
+};
+
+// Daily window in local time, in minutes since midnight, may wrap midnight
+struct Blackout {
+    int begin;
+    int end;
+
+    // Parses "HH:MM-HH:MM"
+    static std::optional<Blackout> parse(const std::string &window);
+    bool contains(std::time_t time) const;
+};
+
+class Job {
+
+  public:
+    std::string name;
+    size_t actuator = 0;
+    // Recurring jobs have a rule, one-shot jobs a start time
+    std::optional<Cron> cron;
+    std::optional<std::time_t> at;
+    // Seconds to hold the value before writing off_value, 0 to never revert
+    int64_t duration_s = 0;
+    float value = 1.0f;
+    float off_value = 0.0f;
+    std::vector<Blackout> blackouts;
+
+    // Runtime state, -1 when not set
+    std::time_t next_start = -1;
+    std::time_t running_until = -1;
+
+    Job(std::string name) : name(name){};
+
+    // Next start strictly after the given time, skipping blackouts
+    std::time_t next_after(std::time_t after) const;
+    bool in_blackout(std::time_t time) const;
+};
+
+// Hierarchical timing wheel with one second ticks. Timers are identified by
+// index and kept in intrusive lists so scheduling, cancelling and ticking are
+// all O(1) no matter how many timers are pending.
+class TimingWheel {
+  public:
+    static const int slot_bits = 6;
+    static const int slots = 1 << slot_bits;
+    static const int levels = 4;
+    static const uint32_t none = UINT32_MAX;
+
+    explicit TimingWheel(int64_t now);
+
+    void resize(size_t timers);
+    void schedule(uint32_t timer, int64_t expires);
+    void cancel(uint32_t timer);
+    bool is_scheduled(uint32_t timer) const;
+
+    // Fires every timer due up to and including the given time
+    template <typename Fire> void advance(int64_t to, Fire &&fire) {
+        while (_now <= to) {
+            if (_pending == 0) {
+                _now = to + 1;
+                break;
+            }
+            int index = _now & (slots - 1);
+            // Pull the next block of each level down once the level below
+            // wraps around
+            for (int level = 1; level < levels && index == 0; level++) {
+                index = (_now >> (level * slot_bits)) & (slots - 1);
+                cascade(level, index);
+            }
+            uint32_t timer = detach(_wheel[0][_now & (slots - 1)]);
+            int64_t tick = _now++;
+            while (timer != none) {
+                uint32_t next = _timers[timer].next;
+                _timers[timer].next = none;
+                _timers[timer].scheduled = false;
+                _pending--;
+                // Timers too far out to fit the wheel come back around
+                if (_timers[timer].expires > tick) {
+                    insert(timer);
+                } else {
+                    fire(timer);
+                }
+                timer = next;
+            }
+        }
+    }
+
+  private:
+    struct Timer {
+        int64_t expires = 0;
+        uint32_t next = none;
+        uint32_t prev = none;
+        int level = 0;
+        int slot = 0;
+        bool scheduled = false;
+    };
+
+    // Next tick to process
+    int64_t _now;
+    size_t _pending = 0;
+    std::vector<Timer> _timers;
+    std::array<std::array<uint32_t, slots>, levels> _wheel;
+
+    void insert(uint32_t timer);
+    uint32_t detach(uint32_t &head);
+    void cascade(int level, int index);
+};
+
+// Start or stop of a job, for the timeline
+struct Entry {
+    std::time_t start;
+    std::time_t stop;
+    size_t job;
+    bool running;
+};
+
+// Runs jobs off a timing wheel and keeps their state in a file so one-shots
+// don't repeat and running jobs resume across restarts
+class Scheduler {
+  public:
+    Scheduler(std::vector<std::unique_ptr<Job>> &jobs, Actuators::Queue &queue,
+              std::string state_file);
+
+    void advance(std::time_t now);
+
+    // The next count starts (running jobs first), only recomputed when a job
+    // changes state, the minute rolls over or more rows are asked for
+    std::vector<Entry> upcoming(std::time_t now, size_t count);
+
+    const std::vector<std::unique_ptr<Job>> &jobs() const { return _jobs; }
+    size_t size() const { return _jobs.size(); }
+
+  private:
+    std::vector<std::unique_ptr<Job>> &_jobs;
+    Actuators::Queue &_queue;
+    std::string _state_file;
+    TimingWheel _wheel;
+    std::mutex _lock;
+
+    // Timeline cache
+    uint64_t _generation = 0;
+    uint64_t _cached_generation = UINT64_MAX;
+    std::time_t _cached_minute = -1;
+    size_t _cached_count = 0;
+    std::vector<Entry> _cached;
+
+    void fire(uint32_t job, std::time_t now);
+    void arm(uint32_t job);
+    void load_state(std::time_t now);
+    void save_state() const;
+};
+
+// Load after the controllers, jobs on an actuator a controller drives are
+// skipped
+void from_toml(std::vector<std::unique_ptr<Job>> &jobs,
+               std::string &state_file,
+               std::vector<std::unique_ptr<Device>> &devices,
+               const std::string &toml_path);
+
+} // namespace Schedule
+
+} // namespace Devices
@@ -0,0 +1,137 @@
+#ifdef DEVICES_TRACE
+
+// std library headers
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// Local headers
+#include "trace.h"
+
+using namespace Devices;
+using namespace Devices::Trace;
+
+// Spans kept per thread, 24 bytes each
+const size_t ring_capacity = 1 << 14;
+
+// Atomic fields so a dump racing the writer reads stale values rather than
+// undefined ones, the dump then drops anything the writer lapped
+struct Event {
+    std::atomic<const char *> name{nullptr};
+    std::atomic<int64_t> start_ns{0};
+    std::atomic<int64_t> duration_ns{0};
+};
+
+struct Ring {
+    std::array<Event, ring_capacity> events;
+    std::atomic<uint64_t> count{0};
+    std::atomic<const char *> thread_name{nullptr};
+    uint32_t tid = 0;
+    Ring *next = nullptr;
+};
+
+// Every ring ever made, pushed on the front as threads first record
+std::atomic<Ring *> rings{nullptr};
+std::atomic<uint32_t> next_tid{1};
+const Clock::time_point epoch = Clock::now();
+
+Ring &thread_ring() {
+    thread_local Ring *ring = [] {
+        // Never freed, a thread's spans are still wanted after it exits
+        Ring *ring = new Ring();
+        ring->tid = next_tid++;
+        ring->next = rings.load();
+        while (!rings.compare_exchange_weak(ring->next, ring)) {
+        }
+        return ring;
+    }();
+    return *ring;
+}
+
+int64_t to_ns(Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+        .count();
+}
+
+void Trace::set_thread_name(const char *name) {
+    thread_ring().thread_name.store(name, std::memory_order_relaxed);
+}
+
+void Trace::record(const char *name, Clock::time_point start,
+                   Clock::time_point end) {
+    Ring &ring = thread_ring();
+    uint64_t count = ring.count.load(std::memory_order_relaxed);
+    Event &event = ring.events[count % ring_capacity];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start_ns.store(to_ns(start - epoch), std::memory_order_relaxed);
+    event.duration_ns.store(to_ns(end - start), std::memory_order_relaxed);
+    ring.count.store(count + 1, std::memory_order_release);
+}
+
+// Microseconds with nanosecond decimals, the unit Chrome traces use
+void write_us(std::ofstream &out, int64_t ns) {
+    out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000;
+}
+
+bool Trace::dump(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    auto separate = [&] {
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+    struct Copy {
+        const char *name;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+    std::vector<Copy> copies;
+    for (Ring *ring = rings.load(); ring != nullptr; ring = ring->next) {
+        const char *thread_name = ring->thread_name.load();
+        if (thread_name != nullptr) {
+            separate();
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                << "\"tid\":" << ring->tid << ",\"args\":{\"name\":\""
+                << thread_name << "\"}}";
+        }
+        uint64_t end = ring->count.load(std::memory_order_acquire);
+        uint64_t begin = end > ring_capacity ? end - ring_capacity : 0;
+        copies.clear();
+        for (uint64_t i = begin; i < end; i++) {
+            const Event &event = ring->events[i % ring_capacity];
+            copies.push_back({event.name.load(std::memory_order_relaxed),
+                              event.start_ns.load(std::memory_order_relaxed),
+                              event.duration_ns.load(
+                                  std::memory_order_relaxed)});
+        }
+        // Slots the writer reused while they were being copied, and the one
+        // it may be filling with the next event
+        uint64_t now = ring->count.load(std::memory_order_acquire);
+        uint64_t lapped = now + 1 > ring_capacity ? now + 1 - ring_capacity : 0;
+        for (uint64_t i = std::max(begin, lapped); i < end; i++) {
+            const Copy &copy = copies[i - begin];
+            separate();
+            out << "{\"name\":\"" << copy.name
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+                << ",\"ts\":";
+            write_us(out, copy.start_ns);
+            out << ",\"dur\":";
+            write_us(out, copy.duration_ns);
+            out << "}";
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+// std library headers
+#include <chrono>
+#include <string>
+
+// Spans for a Chrome trace (chrome://tracing or ui.perfetto.dev), only
+// compiled in when DEVICES_TRACE is defined, see the CMake option of the same
+// name. Without it TRACE_SPAN and TRACE_THREAD expand to nothing.
+//
+// Every thread appends finished spans to its own ring buffer, so recording
+// takes no lock, and the oldest spans are overwritten once a ring is full.
+
+namespace Devices {
+
+namespace Trace {
+
+using Clock = std::chrono::steady_clock;
+
+// Where the UI dumps the trace, on exit and when asked with T
+const std::string default_path = "trace.json";
+
+#ifdef DEVICES_TRACE
+
+const bool compiled_in = true;
+
+// Names the calling thread in the trace, name has to be a literal
+void set_thread_name(const char *name);
+// Adds a finished span to the calling thread's ring, name has to be a literal
+void record(const char *name, Clock::time_point start, Clock::time_point end);
+// Writes every thread's spans as Chrome trace JSON, can be called while the
+// other threads keep recording
+bool dump(const std::string &path);
+
+class Span {
+  public:
+    explicit Span(const char *name) : _name(name), _start(Clock::now()) {}
+    ~Span() { record(_name, _start, Clock::now()); }
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+  private:
+    const char *_name;
+    Clock::time_point _start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Records the rest of the enclosing scope
+#define TRACE_SPAN(name)                                                      \
+    const Devices::Trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_THREAD(name) Devices::Trace::set_thread_name(name)
+
+#else
+
+const bool compiled_in = false;
+
+inline void record(const char *, Clock::time_point, Clock::time_point) {}
+inline bool dump(const std::string &) { return false; }
+
+#define TRACE_SPAN(name) static_cast<void>(0)
+#define TRACE_THREAD(name) static_cast<void>(0)
+
+#endif
+
+} // namespace Trace
+
+} // namespace Devices
@@ -0,0 +1,67 @@
+#pragma once
+
+// std library headers
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace Devices {
+
+namespace Varint {
+
+// Longest encoding of a 64 bit value
+const size_t max_bytes = 10;
+
+// Maps small negative numbers to small unsigned ones: 0, -1, 1, -2, ...
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^
+           static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Seven bits per byte, low bits first, the top bit set on all but the last
+inline void put(std::string &out, uint64_t value) {
+    char bytes[max_bytes];
+    size_t size = 0;
+    while (value >= 0x80) {
+        bytes[size++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    bytes[size++] = static_cast<char>(value);
+    out.append(bytes, size);
+}
+
+// False, leaving offset alone, if data ends first or the value is too long
+inline bool get(const char *data, size_t size, size_t &offset,
+                uint64_t &value) {
+    value = 0;
+    for (size_t i = 0; i < max_bytes && offset + i < size; i++) {
+        uint8_t byte = static_cast<uint8_t>(data[offset + i]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            offset += i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Float bits as an integer, so nearby values of the same sign are nearby
+inline uint32_t float_bits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+} // namespace Varint
+
+} // namespace Devices
@@ -0,0 +1,368 @@
+// std library headers
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// POSIX headers
+#include <fcntl.h>
+#include <unistd.h>
+
+// 3rd party headers
+// ---- tomlplusplus ----
+#include <toml++/toml.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "bytes.h"
+#include "devices.h"
+#include "events.h"
+#include "wal.h"
+
+using namespace Devices;
+using namespace Devices::Wal;
+
+// Fixed part of a record: kind, sequence, time and value, then name length
+const size_t header_bytes = 2 * sizeof(uint32_t);
+const size_t fixed_payload_bytes = sizeof(uint8_t) + sizeof(uint64_t) +
+                                   sizeof(int64_t) + sizeof(float) +
+                                   sizeof(uint16_t);
+// Longest a failed write waits before the next try
+const std::chrono::milliseconds max_retry_delay{10 * 1000};
+
+uint32_t crc32(const char *data, size_t size) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Appends a framed record to the buffer without any temporary allocation
+void encode(std::string &buffer, Kind kind, uint64_t sequence,
+            int64_t time_ns, float value, const std::string &device) {
+    size_t name_bytes = std::min<size_t>(device.size(), UINT16_MAX);
+    uint32_t length = fixed_payload_bytes + name_bytes;
+    size_t start = buffer.size();
+    // The CRC is filled in once the payload is there
+    Bytes::append<uint32_t>(buffer, length);
+    Bytes::append<uint32_t>(buffer, 0);
+    Bytes::append<uint8_t>(buffer, static_cast<uint8_t>(kind));
+    Bytes::append<uint64_t>(buffer, sequence);
+    Bytes::append<int64_t>(buffer, time_ns);
+    Bytes::append<float>(buffer, value);
+    Bytes::append<uint16_t>(buffer, static_cast<uint16_t>(name_bytes));
+    buffer.append(device.data(), name_bytes);
+    Bytes::put<uint32_t>(buffer, start + sizeof(uint32_t),
+                         crc32(buffer.data() + start + header_bytes, length));
+}
+
+bool write_all(int fd, const std::string &data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+void apply(std::map<std::string, State> &states, Kind kind,
+           const std::string &device, float value) {
+    auto &state = states[device];
+    if (kind == Kind::Command) {
+        state.intended = value;
+    } else {
+        state.acked = value;
+    }
+}
+
+std::string Recovery::info() const {
+    std::ostringstream oss;
+    oss << "------------------------" << std::endl;
+    oss << "Write-Ahead Log Recovery" << std::endl;
+    oss << "Records: " << records << std::endl;
+    oss << "Truncated bytes: " << truncated_bytes << std::endl;
+    oss << "Last sequence: " << last_sequence << std::endl;
+    for (const auto &device : reconciled) {
+        oss << "Reconciled: " << device << std::endl;
+    }
+    oss << "------------------------" << std::endl;
+    return oss.str();
+}
+
+Log::Log(const Settings &settings) : _settings(settings) {}
+
+Log::~Log() { stop(); }
+
+Recovery Log::recover() {
+    Recovery recovery;
+    std::ifstream in(_settings.path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    size_t good = 0;
+    std::string device;
+    while (good + header_bytes <= data.size()) {
+        size_t offset = good;
+        uint32_t length = Bytes::get<uint32_t>(data.data(), offset);
+        uint32_t crc = Bytes::get<uint32_t>(data.data(), offset);
+        if (length < fixed_payload_bytes ||
+            offset + length > data.size() ||
+            crc32(data.data() + offset, length) != crc) {
+            break;
+        }
+        auto kind = static_cast<Kind>(Bytes::get<uint8_t>(data.data(), offset));
+        uint64_t sequence = Bytes::get<uint64_t>(data.data(), offset);
+        Bytes::get<int64_t>(data.data(), offset);
+        float value = Bytes::get<float>(data.data(), offset);
+        uint16_t name_bytes = Bytes::get<uint16_t>(data.data(), offset);
+        if (fixed_payload_bytes + name_bytes != length) {
+            break;
+        }
+        device.assign(data.data() + offset, name_bytes);
+        apply(recovery.states, kind, device, value);
+        recovery.last_sequence = std::max(recovery.last_sequence, sequence);
+        recovery.records++;
+        good = offset + name_bytes;
+    }
+    recovery.truncated_bytes = data.size() - good;
+    if (recovery.truncated_bytes > 0) {
+        // Drop the torn tail so new records follow the last good one
+        if (::truncate(_settings.path.c_str(), good) != 0) {
+            std::cerr << "Failed to truncate " << _settings.path << std::endl;
+        }
+    }
+
+    const std::lock_guard<std::mutex> lg(_lock);
+    _sequence = recovery.last_sequence;
+    _durable = recovery.last_sequence;
+    _states = recovery.states;
+    _file_bytes = good;
+    return recovery;
+}
+
+bool Log::start() {
+    _fd = ::open(_settings.path.c_str(),
+                 O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        std::cerr << "Failed to open write-ahead log " << _settings.path
+                  << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    _running = true;
+    _writer = std::thread([this] { write_loop(); });
+    return true;
+}
+
+void Log::stop() {
+    {
+        const std::lock_guard<std::mutex> lg(_lock);
+        if (!_running) {
+            return;
+        }
+        _running = false;
+    }
+    _wake.notify_all();
+    _writer.join();
+    ::close(_fd);
+    _fd = -1;
+}
+
+uint64_t Log::append(Kind kind, const std::string &device, float value) {
+    int64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    uint64_t sequence;
+    {
+        const std::lock_guard<std::mutex> lg(_lock);
+        if (!_running) {
+            return 0;
+        }
+        sequence = ++_sequence;
+        encode(_buffer, kind, sequence, time_ns, value, device);
+        apply(_states, kind, device, value);
+    }
+    _wake.notify_one();
+    return sequence;
+}
+
+void Log::sync() {
+    std::unique_lock<std::mutex> ul(_lock);
+    uint64_t target = _sequence;
+    _wake.notify_one();
+    _synced.wait(ul, [&] { return _durable >= target || !_running; });
+}
+
+uint64_t Log::durable() const {
+    const std::lock_guard<std::mutex> lg(_lock);
+    return _durable;
+}
+
+void Log::write_loop() {
+    std::string batch;
+    bool failed = false;
+    std::chrono::milliseconds retry_delay{0};
+    std::unique_lock<std::mutex> ul(_lock);
+    while (true) {
+        _wake.wait(ul, [&] { return !_buffer.empty() || !_running; });
+        if (_buffer.empty()) {
+            break;
+        }
+        // Everything appended while the last batch was syncing goes out in
+        // one write and one fdatasync
+        batch.swap(_buffer);
+        uint64_t sequence = _sequence;
+        ul.unlock();
+        if (_fd < 0) {
+            _fd = ::open(_settings.path.c_str(),
+                         O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+        // A failed write may have left part of a record at the end, cut it
+        // off so the retry doesn't land behind it
+        bool ok = _fd >= 0 &&
+                  (!failed || ::ftruncate(_fd, _file_bytes) == 0) &&
+                  write_all(_fd, batch) && ::fdatasync(_fd) == 0;
+        int error = errno;
+        ul.lock();
+        if (!ok) {
+            std::cerr << "Failed to write to write-ahead log "
+                      << _settings.path << ": " << std::strerror(error)
+                      << std::endl;
+            // Nothing in the batch is durable, put it back in front of
+            // whatever was appended since and try again later
+            batch += _buffer;
+            _buffer.swap(batch);
+            batch.clear();
+            if (!_running) {
+                break;
+            }
+            failed = true;
+            retry_delay = std::min(
+                max_retry_delay,
+                std::max(_settings.commit_interval, 2 * retry_delay));
+            _wake.wait_for(ul, retry_delay, [&] { return !_running; });
+            continue;
+        }
+        failed = false;
+        retry_delay = std::chrono::milliseconds(0);
+        _file_bytes += batch.size();
+        batch.clear();
+        _durable = sequence;
+        _synced.notify_all();
+        if (_file_bytes > _settings.max_bytes) {
+            compact();
+        }
+        // Bound the fsync rate, appends keep piling up meanwhile
+        _wake.wait_for(ul, _settings.commit_interval,
+                       [&] { return !_running; });
+    }
+    _synced.notify_all();
+}
+
+// Rewrites the log as one command and ack per device, called with the lock
+// held so the snapshot also covers anything still buffered
+void Log::compact() {
+    std::string snapshot;
+    int64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    for (const auto &[device, state] : _states) {
+        if (state.intended.has_value()) {
+            encode(snapshot, Kind::Command, _sequence, time_ns,
+                   state.intended.value(), device);
+        }
+        if (state.acked.has_value()) {
+            encode(snapshot, Kind::Ack, _sequence, time_ns,
+                   state.acked.value(), device);
+        }
+    }
+    std::string temp = _settings.path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0 || !write_all(fd, snapshot) || ::fdatasync(fd) != 0 ||
+        ::rename(temp.c_str(), _settings.path.c_str()) != 0) {
+        std::cerr << "Failed to compact write-ahead log " << _settings.path
+                  << std::endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return;
+    }
+    ::close(_fd);
+    _fd = ::open(_settings.path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (_fd < 0) {
+        // The writer tries again before its next batch
+        std::cerr << "Failed to reopen write-ahead log " << _settings.path
+                  << ": " << std::strerror(errno) << std::endl;
+    }
+    _file_bytes = snapshot.size();
+    _buffer.clear();
+    _durable = _sequence;
+    ::close(fd);
+}
+
+void Wal::reconcile(Recovery &recovery, Log &log,
+                    const std::vector<std::unique_ptr<Device>> &devices,
+                    Actuators::Backend &backend) {
+    std::vector<Actuators::Write> batch;
+    for (size_t i = 0; i < devices.size(); i++) {
+        auto it = recovery.states.find(devices[i]->name);
+        if (it == recovery.states.end() ||
+            !it->second.intended.has_value()) {
+            continue;
+        }
+        float intended = it->second.intended.value();
+        // Round trips through the normalized value aren't exact
+        if (std::fabs(devices[i]->get_value_scaled() - intended) > 1e-3f) {
+            batch.push_back({i, intended, Actuators::Source::Recovery});
+            recovery.reconciled.push_back(devices[i]->name);
+        }
+    }
+    if (batch.empty()) {
+        return;
+    }
+    backend.write(batch);
+    for (const auto &write : batch) {
+        log.append(Kind::Ack, devices[write.device]->name, write.value);
+    }
+}
+
+void Wal::from_toml(Settings &settings, const std::string &toml_path) {
+    try {
+        auto config = toml::parse_file(toml_path);
+        settings.path = config["Wal"]["path"].value_or<std::string>("");
+        settings.commit_interval = std::chrono::milliseconds(
+            config["Wal"]["commit_ms"].value_or<int64_t>(
+                settings.commit_interval.count()));
+        settings.max_bytes = config["Wal"]["max_kb"].value_or<int64_t>(
+                                 settings.max_bytes / 1024) *
+                             1024;
+    } catch (const toml::parse_error &err) {
+        std::cerr << "Failed to parse TOML: " << err.what() << std::endl;
+        Events::config(toml_path, err.what());
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// std library headers
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local headers
+#include "actuator.h"
+#include "devices.h"
+
+namespace Devices {
+
+namespace Wal {
+
+enum class Kind : uint8_t { Command = 1, Ack = 2 };
+
+struct Record {
+    Kind kind;
+    uint64_t sequence;
+    // Wall clock nanoseconds
+    int64_t time_ns;
+    float value;
+    std::string device;
+};
+
+// Last intended (commanded) and acknowledged (written) value per device
+struct State {
+    std::optional<float> intended;
+    std::optional<float> acked;
+};
+
+struct Settings {
+    // Empty to disable the log
+    std::string path;
+    // Longest an append waits to be part of a group commit
+    std::chrono::milliseconds commit_interval{20};
+    // Compact down to one state per device past this size
+    size_t max_bytes = 4 * 1024 * 1024;
+};
+
+struct Recovery {
+    size_t records = 0;
+    // Torn or corrupt bytes dropped from the tail
+    size_t truncated_bytes = 0;
+    uint64_t last_sequence = 0;
+    std::map<std::string, State> states;
+    // Devices rewritten to their intended state
+    std::vector<std::string> reconciled;
+
+    std::string info() const;
+};
+
+// Append-only log of actuator commands and acknowledged writes. Appends only
+// copy into a buffer, a writer thread makes them durable in groups with one
+// write and fdatasync per batch. A batch that fails is cut back off the file
+// and retried with backoff, and only counts as durable once it succeeds.
+//
+// On disk each record is [u32 length][u32 crc32][payload] in host byte order,
+// the payload being kind, sequence, time, value and the device name.
+class Log {
+  public:
+    explicit Log(const Settings &settings);
+    ~Log();
+
+    // Reads the log back, truncating anything after the last good record
+    Recovery recover();
+    // Opens the log for appending and starts the writer thread
+    bool start();
+    void stop();
+
+    uint64_t append(Kind kind, const std::string &device, float value);
+    // Blocks until everything appended so far is on disk
+    void sync();
+    uint64_t durable() const;
+
+  private:
+    Settings _settings;
+    int _fd = -1;
+    size_t _file_bytes = 0;
+    uint64_t _sequence = 0;
+    uint64_t _durable = 0;
+    std::string _buffer;
+    std::map<std::string, State> _states;
+    bool _running = false;
+    std::thread _writer;
+    mutable std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _synced;
+
+    void write_loop();
+    void compact();
+};
+
+// Brings every actuator with a known intended state back to it in a single
+// backend write, acknowledging each write in the log
+void reconcile(Recovery &recovery, Log &log,
+               const std::vector<std::unique_ptr<Device>> &devices,
+               Actuators::Backend &backend);
+
+void from_toml(Settings &settings, const std::string &toml_path);
+
+} // namespace Wal
+
+} // namespace Devices
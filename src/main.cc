@@ -1,13 +1,27 @@
 // std library headers
 #include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <new>
 #include <optional>
+#include <random>
 #include <string>
 #include <thread>
+#include <vector>
+
+// POSIX headers
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // 3rd party headers
 // ---- cxxopts ----
@@ -27,8 +41,16 @@
 #include <ftxui/screen/string.hpp>
 
 // Local headers
+#include "actuator.h"
+#include "control.h"
 #include "devices.h"
 #include "dui.h"
+#include "events.h"
+#include "fleet.h"
+#include "pipeline.h"
+#include "remote.h"
+#include "schedule.h"
+#include "wal.h"
 
 // Example run: ./build_and_run.sh -h
 void hello_world() { std::cout << "Hello, World!" << std::endl; }
@@ -79,9 +101,226 @@ int devices_parser(const std::string &toml_path) {
         std::cout << device->info();
     }
 
+    std::vector<std::unique_ptr<Devices::Control::Loop>> loops;
+    Devices::Control::from_toml(loops, devices, toml_path);
+    std::cout << "Found " << loops.size() << " controllers." << std::endl;
+
+    for (auto &loop : loops) {
+        std::cout << loop->info(devices);
+    }
+
     return ret;
 }
 
+// Example run: ./build_and_run.sh -c 100
+int wal_crash_test(int iterations) {
+    using namespace Devices;
+
+    const std::vector<std::string> names = {"pump-switch-0", "fan-0",
+                                            "solenoid-valve-0", "heater-0"};
+    // Written by the child once its appends are durable, survives its death
+    struct Shared {
+        std::atomic<uint64_t> durable;
+        float values[4];
+    };
+    auto *shared = static_cast<Shared *>(
+        mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shared == MAP_FAILED) {
+        std::cout << "Failed to map shared memory." << std::endl;
+        return 1;
+    }
+    new (shared) Shared{};
+
+    Wal::Settings settings;
+    settings.path = "wal_crash_test.wal";
+    settings.commit_interval = std::chrono::milliseconds(1);
+    // Small enough to compact a few times per run
+    settings.max_bytes = 64 * 1024;
+    std::remove(settings.path.c_str());
+
+    std::mt19937 rng(std::random_device{}());
+    int failures = 0;
+    for (int i = 0; i < iterations; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            Wal::Log log(settings);
+            uint64_t value = log.recover().last_sequence;
+            log.start();
+            float values[4] = {};
+            while (true) {
+                // Values only grow, so a recovered value can't go backwards
+                value++;
+                values[value % 4] = value;
+                log.append(Wal::Kind::Command, names[value % 4], value);
+                if (value % 16 == 0) {
+                    log.sync();
+                    for (int d = 0; d < 4; d++) {
+                        shared->values[d] = values[d];
+                    }
+                    shared->durable = log.durable();
+                }
+            }
+        }
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(1 + rng() % 50));
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+
+        // Every other crash also leaves half a record behind
+        if (i % 2 == 1) {
+            FILE *file = std::fopen(settings.path.c_str(), "ab");
+            for (size_t b = 0; b < 1 + rng() % 40; b++) {
+                std::fputc(static_cast<int>(rng() & 0xFF), file);
+            }
+            std::fclose(file);
+        }
+
+        Wal::Log log(settings);
+        auto recovery = log.recover();
+        bool ok = recovery.last_sequence >= shared->durable.load();
+        for (int d = 0; d < 4; d++) {
+            auto it = recovery.states.find(names[d]);
+            float recovered = it == recovery.states.end() ||
+                                      !it->second.intended.has_value()
+                                  ? 0.0f
+                                  : it->second.intended.value();
+            ok = ok && recovered >= shared->values[d];
+        }
+        if (!ok) {
+            failures++;
+            std::cout << "Iteration " << i << ": lost durable records, "
+                      << "recovered up to " << recovery.last_sequence
+                      << " of " << shared->durable.load() << std::endl;
+        }
+    }
+    std::remove(settings.path.c_str());
+    munmap(shared, sizeof(Shared));
+
+    std::cout << iterations - failures << "/" << iterations
+              << " crashes recovered every durable record." << std::endl;
+    return failures > 0 ? 1 : 0;
+}
+
+// Sets up everything a device config describes and hands the pipeline to
+// run, which starts and stops it. Prints the controller, queue and recovery
+// summaries afterwards.
+int run_devices(const std::string &toml_file, bool alarms,
+                const std::function<void(Devices::Pipeline::Runner &)> &run) {
+    std::srand(std::time(0));
+    std::vector<std::unique_ptr<Devices::Device>> devices;
+    Devices::from_toml(devices, toml_file);
+    if (devices.size() == 0) {
+        std::cout << "No devices found in the TOML file." << std::endl;
+        return 1;
+    }
+    // Started before the rest of the config is read, so its errors get
+    // logged too
+    Devices::Events::Settings event_settings;
+    Devices::Events::from_toml(event_settings, toml_file);
+    Devices::Events::Log events(event_settings, devices);
+    bool eventing = !event_settings.path.empty() && events.start();
+    if (eventing) {
+        Devices::Events::install(&events);
+    }
+    std::vector<std::unique_ptr<Devices::Control::Loop>> loops;
+    Devices::Control::from_toml(loops, devices, toml_file);
+    std::vector<std::unique_ptr<Devices::Schedule::Job>> jobs;
+    std::string state_file;
+    Devices::Schedule::from_toml(jobs, state_file, devices, toml_file);
+    Devices::Actuators::SimulatedBackend backend(devices);
+    // Put actuators back where they were commanded before any of the
+    // control threads start
+    Devices::Wal::Settings wal_settings;
+    Devices::Wal::from_toml(wal_settings, toml_file);
+    Devices::Wal::Log log(wal_settings);
+    Devices::Wal::Recovery recovery;
+    bool logging = !wal_settings.path.empty();
+    if (logging) {
+        recovery = log.recover();
+        logging = log.start();
+        Devices::Wal::reconcile(recovery, log, devices, backend);
+    }
+    Devices::Actuators::Queue queue(devices, backend);
+    Devices::Actuators::from_toml(queue, devices, toml_file);
+    if (logging) {
+        queue.set_log(&log);
+    }
+    Devices::Schedule::Scheduler scheduler(jobs, queue, state_file);
+    Devices::Pipeline::Settings settings;
+    Devices::Pipeline::from_toml(settings, toml_file);
+    settings.alarms = settings.alarms || alarms;
+    Devices::Events::config(toml_file, "");
+    {
+        Devices::Pipeline::Runner pipeline(devices, loops, scheduler, queue,
+                                           settings);
+        run(pipeline);
+    }
+    log.stop();
+    // Every thread that logs events has stopped with the pipeline
+    Devices::Events::install(nullptr);
+    events.stop();
+    // Leave the controller timings behind for tuning
+    for (auto &loop : loops) {
+        std::cout << loop->info(devices);
+    }
+    std::cout << queue.info();
+    if (logging) {
+        std::cout << recovery.info();
+    }
+    if (eventing) {
+        std::cout << events.info();
+    }
+    return 0;
+}
+
+// Example run: ./build_and_run.sh -e garden.events
+int print_events(const std::string &path) {
+    std::vector<std::string> names;
+    std::vector<Devices::Events::Event> events;
+    if (!Devices::Events::read_file(path, names, events)) {
+        std::cout << path << " is not an event log." << std::endl;
+        return 1;
+    }
+    for (const auto &event : events) {
+        std::cout << Devices::Events::to_string(event, names) << std::endl;
+    }
+    return 0;
+}
+
+// Signals the daemon waits for instead of being killed by
+sigset_t daemon_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    return signals;
+}
+
+// Example run: ./build_and_run.sh --daemon test_files/device_config.toml
+// Runs the pipeline without a terminal until SIGINT or SIGTERM, SIGHUP saves
+// the history right away. The caller blocks daemon_signals() before any
+// thread is created, so they only ever arrive at sigwait below.
+void run_daemon(Devices::Pipeline::Runner &pipeline) {
+    sigset_t signals = daemon_signals();
+    pipeline.start();
+    std::cout << "Running " << pipeline.devices().size() << " devices, "
+              << pipeline.restored() << " with saved history" << std::endl;
+    while (true) {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0) {
+            break;
+        }
+        if (signal != SIGHUP) {
+            std::cout << "Stopping on " << strsignal(signal) << std::endl;
+            break;
+        }
+        pipeline.flush_history();
+    }
+    pipeline.stop();
+}
+
 // Example run: ./build_and_run.sh -f 0
 void ftxui_demo() {
     // Demo as seen here https://github.com/ArthurSonzogni/ftxui-starter
@@ -777,7 +1016,26 @@ int main(int argc, char *argv[]) {
                                        "Parse a device config TOML file.",
                                        cxxopts::value<std::string>())(
         "f,ftxui", "Sample ftxui usage.", cxxopts::value<int>())(
-        "u,ui", "Run device UI.", cxxopts::value<std::string>());
+        "u,ui",
+        "Run device UI, or attach to one served on the given Unix socket.",
+        cxxopts::value<std::string>())(
+        "daemon", "Run the devices without a UI until SIGINT or SIGTERM.",
+        cxxopts::value<std::string>())(
+        "c,crash", "Kill a write-ahead log writer this many times.",
+        cxxopts::value<int>())(
+        "e,events", "Print the events in an event log file.",
+        cxxopts::value<std::string>())("fps", "Device UI frame rate limit.",
+                               cxxopts::value<int>()->default_value("20"))(
+        "g,generate", "Print a device config with this many devices.",
+        cxxopts::value<size_t>())(
+        "analog", "Share of generated devices that are analog.",
+        cxxopts::value<double>()->default_value("0.6"))(
+        "inout", "Share of generated devices of each type that are InOut.",
+        cxxopts::value<double>()->default_value("0.2"))(
+        "thresholds", "Threshold ranges on each generated analog device.",
+        cxxopts::value<int>()->default_value("3"))(
+        "zones", "Zones the generated devices are spread over.",
+        cxxopts::value<int>()->default_value("1"));
     auto result = options.parse(argc, argv);
 
     // Return signal, by default assume happy 0
@@ -800,6 +1058,27 @@ int main(int argc, char *argv[]) {
         ret = devices_parser(toml_file);
     }
 
+    // Handle config generator option
+    if (result.count("generate") > 0) {
+        Devices::Fleet::Spec spec;
+        spec.devices = result["generate"].as<size_t>();
+        spec.analog = result["analog"].as<double>();
+        spec.in_out = result["inout"].as<double>();
+        spec.thresholds = result["thresholds"].as<int>();
+        spec.zones = result["zones"].as<int>();
+        std::cout << Devices::Fleet::to_toml(spec);
+    }
+
+    // Handle write-ahead log crash test
+    if (result.count("crash") > 0) {
+        ret = wal_crash_test(result["crash"].as<int>());
+    }
+
+    // Handle event log option
+    if (result.count("events") > 0) {
+        ret = print_events(result["events"].as<std::string>());
+    }
+
     // Handle ftxui option
     if (result.count("ftxui") > 0) {
         switch (result["ftxui"].as<int>()) {
@@ -868,17 +1147,38 @@ int main(int argc, char *argv[]) {
 
     // Handle device UI option
     if (result.count("ui") > 0) {
-        std::srand(std::time(0));
-        std::string toml_file = result["ui"].as<std::string>();
-        std::vector<std::unique_ptr<Devices::Device>> devices;
-        Devices::from_toml(devices, toml_file);
-        if (devices.size() > 0) {
-            Devices::UI::run(devices);
+        std::string path = result["ui"].as<std::string>();
+        int max_fps = result["fps"].as<int>();
+        struct stat status;
+        if (::stat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+            // Attach to a daemon or another UI serving on this socket
+            Devices::Remote::Client client(path);
+            if (client.connect()) {
+                Devices::UI::attach(client, max_fps);
+                if (!client.connected()) {
+                    std::cout << "Lost connection to " << path << std::endl;
+                }
+            } else {
+                ret = 1;
+            }
         } else {
-            std::cout << "No devices found in the TOML file." << std::endl;
-            ret = 1; // Return error if no devices found
+            ret = run_devices(path, false,
+                              [&](Devices::Pipeline::Runner &pipeline) {
+                                  Devices::UI::run(pipeline, max_fps);
+                              });
         }
     }
 
+    // Handle headless daemon option
+    if (result.count("daemon") > 0) {
+        // Blocked before run_devices starts the write-ahead log, event log
+        // or any stage, so every thread inherits the mask
+        sigset_t signals = daemon_signals();
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        ret = run_devices(result["daemon"].as<std::string>(), true,
+                          run_daemon);
+        pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+    }
+
     return ret;
 }
@@ -0,0 +1,1025 @@
+// std library headers
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// 3rd party headers
+// ---- ftxui ----
+#include <ftxui/component/component.hpp>
+#include <ftxui/component/screen_interactive.hpp>
+#include <ftxui/dom/node.hpp>
+#include <ftxui/screen/screen.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "control.h"
+#include "devices.h"
+#include "dui.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "remote.h"
+#include "schedule.h"
+#include "trace.h"
+
+using namespace ftxui;
+
+// Every history lock taken on the UI thread goes through here
+Devices::Perf::TimedLock lock_hist(std::mutex &hist_lock) {
+    auto &counters = Devices::Perf::counters();
+    return {hist_lock, counters.ui_hist_wait, counters.ui_hist_hold};
+}
+
+ftxui::Decorator value_color(const Devices::Device &device, const float value) {
+    using namespace Devices;
+    using namespace ftxui;
+
+    switch (device.type) {
+    case Type::Analog: {
+        float value_scaled =
+            value * (device.rel_max.value() - device.rel_min.value()) +
+            device.rel_min.value();
+
+        if (device.is_warning(value_scaled)) {
+            return color(Color::Red1);
+        } else if (device.is_caution(value_scaled)) {
+            return color(Color::Yellow1);
+        } else if (device.is_optimal(value_scaled)) {
+            return color(Color::Green1);
+        } else {
+            return color(Color::Default);
+        }
+    }
+    case Type::Digital:
+    default:
+        return color(Color::Default);
+    }
+}
+
+ftxui::Element value_text(const Devices::Device &device, const float value,
+                          Devices::FloatMemo &memo) {
+    using namespace Devices;
+    using namespace ftxui;
+
+    switch (device.type) {
+    case Type::Analog: {
+        float value_scaled =
+            value * (device.rel_max.value() - device.rel_min.value()) +
+            device.rel_min.value();
+
+        const std::string &value_str = memo(value_scaled);
+        std::string units_abbreviation_str =
+            device.units_abbreviation.has_value()
+                ? " " + device.units_abbreviation.value()
+                : "";
+
+        return hbox(text(value_str) | value_color(device, value),
+                    text(units_abbreviation_str)) |
+               bold;
+    }
+    case Type::Digital: {
+        std::string value_str = device.is_active_low.value()
+                                    ? (value == 0 ? "Active" : "Inactive")
+                                    : (value == 0 ? "Inactive" : "Active");
+
+        return text(value_str) | bold;
+    }
+    default:
+        return text("N/A");
+    }
+}
+
+// Same drawing as ftxui's graph(), but the columns come from the device's
+// cached transform instead of a freshly allocated vector every frame, and
+// each column is a band from its lowest to highest sample
+class HistoryGraph : public Node {
+  public:
+    HistoryGraph(const Devices::Device &device, std::mutex &hist_lock)
+        : _device(device), _hist_lock(hist_lock) {}
+
+    void ComputeRequirement() override {
+        requirement_.flex_grow_x = 1;
+        requirement_.flex_grow_y = 1;
+        requirement_.flex_shrink_x = 1;
+        requirement_.flex_shrink_y = 1;
+        requirement_.min_x = 3;
+        requirement_.min_y = 3;
+    }
+
+    void Render(Screen &screen) override {
+        static const std::string charset[] = {" ", "▗", "▐", "▖", "▄",
+                                              "▟", "▌", "▙", "█"};
+        const int width = (box_.x_max - box_.x_min + 1) * 2;
+        const int height = (box_.y_max - box_.y_min + 1) * 2;
+        if (width <= 0 || height <= 0) {
+            return;
+        }
+        // Drawing happens after the renderer released the lock
+        const auto lg = lock_hist(_hist_lock);
+        const auto &data = _device.get_value_transform(width, height);
+        int i = 0;
+        for (int x = box_.x_min; x <= box_.x_max; x++) {
+            const int height_1 = 2 * box_.y_max - data[i].high;
+            const int low_1 = 2 * box_.y_max - data[i++].low;
+            const int height_2 = 2 * box_.y_max - data[i].high;
+            const int low_2 = 2 * box_.y_max - data[i++].low;
+            for (int y = box_.y_min; y <= box_.y_max; y++) {
+                const int yy = 2 * y;
+                int i_1 = yy < height_1 ? 0 : yy == height_1 ? 3 : 6;
+                int i_2 = yy < height_2 ? 0 : yy == height_2 ? 1 : 2;
+                auto &pixel = screen.PixelAt(x, y);
+                pixel.character = charset[i_1 + i_2];
+                // Cells only covered by the min/max band are dimmed
+                pixel.dim = yy + 1 < low_1 && yy + 1 < low_2;
+            }
+        }
+    }
+
+  private:
+    const Devices::Device &_device;
+    std::mutex &_hist_lock;
+};
+
+// The parts of a detail view that only change with the config, built once
+// per config generation instead of every frame
+struct DetailCache {
+    uint64_t config_generation = 0;
+    Devices::Graph::Mode graph_mode = Devices::Graph::Mode::Nearest;
+    bool valid = false;
+    Element info;
+    Element y_axis_units;
+    Decorator thresholds;
+    // Last formatted value
+    Devices::FloatMemo value_text;
+};
+
+void build_detail_cache(const Devices::Device &device, DetailCache &cache) {
+    using namespace Devices;
+
+    std::vector<Element> info;
+    info.push_back(text(" Pin:        " + std::to_string(device.pin) + " "));
+    info.push_back(
+        text(" Type:       " + Devices::type_to_string(device.type) + " "));
+    info.push_back(text(" Modality:   " +
+                        Devices::modality_to_string(device.modality) + " "));
+    if (device.expression.has_value()) {
+        info.push_back(
+            text(" Expression: " + device.expression.value() + " "));
+    }
+    if (device.modality == Modality::InOut) {
+        info.push_back(text(device.type == Type::Digital
+                                ? " Command:    [t] toggle "
+                                : " Command:    [+/-] adjust "));
+    }
+    info.push_back(text(" Graph:      [m] " +
+                        Graph::mode_to_string(device.get_graph_mode()) +
+                        " "));
+    switch (device.type) {
+    case Type::Analog: {
+        const auto &units = device.units;
+        const auto &abs_min = device.abs_min;
+        const auto &abs_max = device.abs_max;
+        const auto &rel_min = device.rel_min;
+        const auto &rel_max = device.rel_max;
+        info.push_back(text(
+            " Units:      " + (units.has_value() ? units.value() : "N/A") +
+            " "));
+        info.push_back(
+            text(" Absolute min: " +
+                 (abs_min.has_value() ? std::to_string(abs_min.value())
+                                      : "N/A") +
+                 " "));
+        info.push_back(
+            text(" Absolute max: " +
+                 (abs_max.has_value() ? std::to_string(abs_max.value())
+                                      : "N/A") +
+                 " "));
+        info.push_back(
+            text(" Relative min: " +
+                 (rel_min.has_value() ? float_to_string(rel_min.value())
+                                      : "N/A") +
+                 " "));
+        info.push_back(
+            text(" Relative max: " +
+                 (rel_max.has_value() ? float_to_string(rel_max.value())
+                                      : "N/A") +
+                 " "));
+        for (const auto &warning : device.warnings) {
+            info.push_back(text(" Warning: [" +
+                                float_to_string(warning.first) + ", " +
+                                float_to_string(warning.second) + "] "));
+        }
+        for (const auto &caution : device.cautions) {
+            info.push_back(text(" Caution: [" +
+                                float_to_string(caution.first) + ", " +
+                                float_to_string(caution.second) + "] "));
+        }
+        for (const auto &optimal : device.optimals) {
+            info.push_back(text(" Optimal: [" +
+                                float_to_string(optimal.first) + ", " +
+                                float_to_string(optimal.second) + "] "));
+        }
+        std::string units_str =
+            (device.units_abbreviation.has_value()
+                 ? " " + device.units_abbreviation.value()
+                 : "");
+        std::string rel_min_str = float_to_string(rel_min.value()) + units_str;
+        std::string rel_max_str = float_to_string(rel_max.value()) + units_str;
+        std::string rel_half_str =
+            float_to_string((rel_max.value() + rel_min.value()) / 2) +
+            units_str;
+        std::string rel_75_str =
+            float_to_string(3 * (rel_max.value() + rel_min.value()) / 4) +
+            units_str;
+        std::string rel_25_str =
+            float_to_string((rel_max.value() + rel_min.value()) / 4) +
+            units_str;
+        cache.y_axis_units =
+            vbox(text(rel_max_str), filler(), text(rel_75_str), filler(),
+                 text(rel_half_str), filler(), text(rel_25_str), filler(),
+                 text(rel_min_str));
+        break;
+    }
+    case Type::Digital: {
+        const auto &is_active_low = device.is_active_low;
+        info.push_back(
+            text(" Active Low: " +
+                 (is_active_low.has_value()
+                      ? (is_active_low.value() ? std::string("Yes")
+                                               : std::string("No"))
+                      : "N/A") +
+                 " "));
+        cache.y_axis_units = vbox(text("High"), filler(), text("Low"));
+        break;
+    }
+    }
+    std::vector<std::vector<Element>> groupings;
+    for (int i = 0; i < info.size(); i++) {
+        if (i % 4 == 0) {
+            std::vector<Element> grouping;
+            groupings.push_back(grouping);
+        }
+        groupings.at(i / 4).push_back(info.at(i));
+    }
+    std::vector<Element> vboxes;
+    for (auto &grouping : groupings) {
+        vboxes.push_back(vbox(grouping));
+        vboxes.push_back(separator());
+    }
+    vboxes.pop_back();
+    cache.info = hbox(vboxes);
+    cache.thresholds = UI::device_thresholds(device);
+    cache.config_generation = device.config_generation();
+    cache.graph_mode = device.get_graph_mode();
+    cache.valid = true;
+}
+
+Component Devices::UI::device_detailed(const Devices::Device &device,
+                                        std::mutex &hist_lock) {
+    using namespace Devices;
+
+    auto graph = std::make_shared<HistoryGraph>(device, hist_lock);
+    return Renderer([&device, graph, cache = DetailCache()]() mutable {
+        TRACE_SPAN("DetailView");
+        if (!cache.valid ||
+            cache.config_generation != device.config_generation() ||
+            cache.graph_mode != device.get_graph_mode()) {
+            build_detail_cache(device, cache);
+        }
+        // Only the value and the graph change from frame to frame
+        float value = (device.type == Type::Analog)
+                          ? device.get_value_analog()
+                          : device.get_value_digital();
+        auto value_element = vbox(
+            {text(" Value: "),
+             hbox({text(" "), value_text(device, value, cache.value_text),
+                   text(" ")})});
+        auto graph_element =
+            hbox({graph | color(Color::Default),
+                  separatorHeavy() | cache.thresholds, cache.y_axis_units}) |
+            flex;
+        return vbox({window(text(" Info ") | bold,
+                            hbox({value_element, separator(), cache.info})),
+                     window(text(" History ") | bold, graph_element)}) |
+               flex;
+    });
+}
+
+// Characters of history next to each overview row, two columns each
+const int sparkline_width = 20;
+
+Element Devices::UI::device_overview(const Devices::Device &device,
+                                     bool focused, OverviewText &texts) {
+    using namespace Devices;
+
+    Element element;
+    switch (device.type) {
+    case Type::Analog: {
+        float value = device.get_value_analog();
+        const std::string &min_str = texts.min(device.rel_min.value());
+        const std::string &max_str = texts.max(device.rel_max.value());
+        element =
+            window(text(" " + device.name + " "),
+                   hbox({
+                       hbox({text("Value: "),
+                             value_text(device, value, texts.value)}) |
+                           size(WIDTH, EQUAL, 18),
+                       separator(),
+                       separator(),
+                       text(min_str) | hcenter | size(WIDTH, EQUAL, 8),
+                       separator(),
+                       gauge(value) | value_color(device, value),
+                       separator(),
+                       text(max_str) | hcenter | size(WIDTH, EQUAL, 8),
+                       separator(),
+                       text(device.get_value_sparkline(sparkline_width)),
+                   }));
+        break;
+    }
+    case Type::Digital: {
+        int value = device.get_value_digital();
+        std::string state = device.is_active_low.value()
+                                ? (value == 0 ? "Active" : "Inactive")
+                                : (value == 0 ? "Inactive" : "Active");
+        element =
+            window(text(" " + device.name + " "),
+                   hbox({
+                       hbox({text("State: "),
+                             value_text(device, value, texts.value)}) |
+                           size(WIDTH, EQUAL, 18),
+                       separator(),
+                       separator(),
+                       text("Low") | hcenter | size(WIDTH, EQUAL, 8),
+                       separator(),
+                       gauge(value),
+                       separator(),
+                       text("High") | hcenter | size(WIDTH, EQUAL, 8),
+                       separator(),
+                       text(device.get_value_sparkline(sparkline_width)),
+                   }));
+        break;
+    }
+    default: {
+        element = window(text(" " + device.name + " "),
+                         text("This device does not have a type."));
+        break;
+    }
+    }
+    return (focused) ? element | inverted : element;
+}
+
+Decorator Devices::UI::device_thresholds(const Devices::Device &device) {
+    using namespace Devices;
+
+    if (device.type == Type::Analog) {
+        auto uncovered = device.find_uncovered_intervals();
+        std::map<std::pair<float, float>, Color> intervals_to_color;
+        auto add_to_map =
+            [](std::map<std::pair<float, float>, Color> &intervals_to_color,
+               const std::vector<std::pair<float, float>> &intervals,
+               Color color) {
+                for (auto &interval : intervals) {
+                    intervals_to_color[interval] = color;
+                }
+            };
+        add_to_map(intervals_to_color, device.warnings, Color::Red1);
+        add_to_map(intervals_to_color, device.cautions, Color::Yellow1);
+        add_to_map(intervals_to_color, device.optimals, Color::Green1);
+        add_to_map(intervals_to_color, uncovered, Color::Default);
+        LinearGradient lg = LinearGradient().Angle(270);
+        auto set_stops = [&device](LinearGradient &lg,
+                                   const std::map<std::pair<float, float>,
+                                                  Color> &intervals_to_color) {
+            auto normalize = [&device](float value) {
+                return (value - device.rel_min.value()) /
+                       (device.rel_max.value() - device.rel_min.value());
+            };
+            for (const auto &[interval, color] : intervals_to_color) {
+                auto min = normalize(interval.first);
+                auto max = normalize(interval.second);
+                lg = lg.Stop(color, min).Stop(color, max);
+            }
+        };
+        set_stops(lg, intervals_to_color);
+        return color(lg);
+    }
+    return color(Color::Default);
+}
+
+
+Component Devices::UI::DetailsView::tab_view(size_t device) {
+    auto it = _tab_view_index.find(device);
+    if (it != _tab_view_index.end()) {
+        _tab_views.splice(_tab_views.begin(), _tab_views, it->second);
+        return it->second->second;
+    }
+    _tab_views.emplace_front(device,
+                             device_detailed(*_devices[device], _hist_lock));
+    _tab_view_index[device] = _tab_views.begin();
+    if (_tab_views.size() > max_tab_views) {
+        _tab_view_index.erase(_tab_views.back().first);
+        _tab_views.pop_back();
+    }
+    return _tab_views.front().second;
+}
+
+Devices::UI::DetailsView::DetailsView(
+    const std::vector<std::unique_ptr<Devices::Device>> &devices,
+    std::mutex &hist_lock, Devices::Actuators::Queue &queue)
+    : _devices(devices), _hist_lock(hist_lock), _queue(queue) {
+    for (auto &device : devices) {
+        _menu_width = std::max(_menu_width,
+                               static_cast<int>(device->get_name().length()));
+    }
+    _menu_width += 3;
+    _menu_width = std::min(_menu_width, 50);
+    _tab_toggle = Make<VirtualList>(
+        [this] { return _devices.size(); },
+        [this](size_t index, bool focused) {
+            bool selected = static_cast<int>(index) == _tab_selected;
+            Element entry =
+                text((selected ? "> " : "  ") + _devices[index]->get_name());
+            if (selected) {
+                entry = entry | bold;
+            }
+            return focused ? entry | inverted : entry;
+        },
+        1, &_tab_selected);
+    _renderer = Renderer(_tab_toggle, [this] {
+        TRACE_SPAN("DetailsView");
+        const auto lg = lock_hist(_hist_lock);
+        return hbox({
+                   _tab_toggle->Render() | size(WIDTH, EQUAL, _menu_width),
+                   separator(),
+                   tab_view(_tab_selected)->Render() | flex,
+               }) |
+               flex;
+    });
+    _renderer |= CatchEvent([this](Event event) {
+        auto &device = *_devices[_tab_selected];
+        if (event == Event::Character('m')) {
+            const auto lg = lock_hist(_hist_lock);
+            auto mode = device.get_graph_mode();
+            auto it = std::find(Graph::all_modes.begin(),
+                                Graph::all_modes.end(), mode);
+            device.set_graph_mode(
+                ++it == Graph::all_modes.end() ? Graph::all_modes[0] : *it);
+            return true;
+        }
+        if (device.modality != Modality::InOut) {
+            return false;
+        }
+        float value = device.get_value_scaled();
+        if (device.type == Type::Digital && event == Event::Character('t')) {
+            value = (value != 0.0f) ? 0.0f : 1.0f;
+        } else if (device.type == Type::Analog &&
+                   (event == Event::Character('+') ||
+                    event == Event::Character('-'))) {
+            float step =
+                (device.rel_max.value() - device.rel_min.value()) / 100.0f;
+            value += (event == Event::Character('+')) ? step : -step;
+        } else {
+            return false;
+        }
+        // Keep the simulated walk from undoing the command
+        device.drive();
+        _queue.submit(_tab_selected, value, Actuators::Source::UI);
+        return true;
+    });
+}
+
+int Devices::UI::VirtualList::visible_rows() const {
+    return std::max((_box.y_max - _box.y_min + 1) / _row_height, 1);
+}
+
+Element Devices::UI::VirtualList::OnRender() {
+    int count = _size();
+    if (count == 0) {
+        return emptyElement() | reflect(_box);
+    }
+    int visible = visible_rows();
+    *_selected = std::clamp(*_selected, 0, count - 1);
+    // Scroll just enough to keep the selection in view
+    if (*_selected < _offset) {
+        _offset = *_selected;
+    } else if (*_selected >= _offset + visible) {
+        _offset = *_selected - visible + 1;
+    }
+    _offset = std::clamp(_offset, 0, std::max(count - visible, 0));
+
+    int last = std::min(count, _offset + visible + overscan);
+    Elements rows;
+    rows.reserve(last - _offset);
+    for (int i = _offset; i < last; i++) {
+        bool selected = i == *_selected;
+        Element row = _row(i, selected && Focused());
+        rows.push_back(selected ? row | focus : row);
+    }
+
+    // Scrollbar for the whole list, not just the rows that were built
+    int lines = visible * _row_height;
+    int thumb_size = std::max(lines * visible / count, 1);
+    int thumb_start = std::min(lines * _offset / count, lines - thumb_size);
+    Elements bar;
+    bar.reserve(lines);
+    for (int i = 0; i < lines; i++) {
+        bool thumb = i >= thumb_start && i < thumb_start + thumb_size;
+        bar.push_back(text(thumb ? "┃" : " "));
+    }
+    return hbox({vbox(rows) | yframe | flex, vbox(bar)}) | reflect(_box);
+}
+
+bool Devices::UI::VirtualList::OnEvent(Event event) {
+    int count = _size();
+    int selected = *_selected;
+    if (event == Event::ArrowUp || event == Event::Character('k')) {
+        selected--;
+    } else if (event == Event::ArrowDown || event == Event::Character('j')) {
+        selected++;
+    } else if (event == Event::PageUp) {
+        selected -= visible_rows();
+    } else if (event == Event::PageDown) {
+        selected += visible_rows();
+    } else if (event == Event::Home) {
+        selected = 0;
+    } else if (event == Event::End) {
+        selected = count - 1;
+    } else {
+        return false;
+    }
+    // Let the parent move focus when stepping off either end
+    if ((selected < 0 && *_selected == 0) ||
+        (selected >= count && *_selected == count - 1)) {
+        return false;
+    }
+    *_selected = std::clamp(selected, 0, std::max(count - 1, 0));
+    return true;
+}
+
+Devices::UI::OverviewView::OverviewView(
+    const std::vector<std::unique_ptr<Devices::Device>> &devices,
+    std::mutex &hist_lock)
+    : _devices(devices), _hist_lock(hist_lock) {
+    _list = Make<VirtualList>(
+        [this] { return _devices.size(); },
+        [this](size_t index, bool focused) {
+            return device_overview(*_devices[index], focused,
+                                   _texts[index]);
+        },
+        3, &_device_selected);
+    _renderer = Renderer(_list, [&] {
+        TRACE_SPAN("OverviewView");
+        const auto lg = lock_hist(_hist_lock);
+        _texts.resize(_devices.size());
+        return _list->Render();
+    });
+}
+
+// Colors of the compared series, reused past the sixteenth
+const std::array<Color, 16> series_colors = {
+    Color::Red1,        Color::Green1,      Color::Yellow1, Color::DeepSkyBlue1,
+    Color::Magenta1,    Color::Cyan1,       Color::Orange1, Color::SpringGreen1,
+    Color::Purple,      Color::Gold1,       Color::Pink1,   Color::SteelBlue1,
+    Color::Chartreuse1, Color::Salmon1,     Color::Orchid,  Color::Aquamarine1};
+
+// Every compared series drawn as a braille line on one canvas, the bottom
+// row being the time axis. A cell where series cross takes the color of the
+// one picked last.
+class OverlayGraph : public Node {
+  public:
+    OverlayGraph(const std::vector<std::unique_ptr<Devices::Device>> &devices,
+                 const std::vector<size_t> &series,
+                 std::vector<uint16_t> &cells, std::mutex &hist_lock)
+        : _devices(devices), _series(series), _cells(cells),
+          _hist_lock(hist_lock) {}
+
+    void ComputeRequirement() override {
+        requirement_.flex_grow_x = 1;
+        requirement_.flex_grow_y = 1;
+        requirement_.flex_shrink_x = 1;
+        requirement_.flex_shrink_y = 1;
+        requirement_.min_x = 3;
+        requirement_.min_y = 2;
+    }
+
+    void Render(Screen &screen) override {
+        const int cells_x = box_.x_max - box_.x_min + 1;
+        const int cells_y = box_.y_max - box_.y_min;
+        if (cells_x <= 0 || cells_y <= 0) {
+            return;
+        }
+        const int width = 2 * cells_x;
+        const int height = 4 * cells_y;
+        // Low byte dot bits, high byte color
+        _cells.assign(cells_x * cells_y, 0);
+        int samples = 0;
+        {
+            const auto lg = lock_hist(_hist_lock);
+            for (size_t s = 0; s < _series.size(); s++) {
+                const auto &device = *_devices[_series[s]];
+                const auto &columns = device.get_value_overlay(width, height);
+                samples = device.get_overlay_samples();
+                draw(columns, (s % series_colors.size()) << 8, cells_x,
+                     cells_y);
+            }
+        }
+
+        char glyph[3];
+        for (int y = 0; y < cells_y; y++) {
+            for (int x = 0; x < cells_x; x++) {
+                uint16_t cell = _cells[y * cells_x + x];
+                if ((cell & 0xFF) == 0) {
+                    continue;
+                }
+                Devices::Graph::braille_utf8(cell & 0xFF, glyph);
+                auto &pixel = screen.PixelAt(box_.x_min + x, box_.y_min + y);
+                pixel.character.assign(glyph, sizeof(glyph));
+                pixel.foreground_color = series_colors[cell >> 8];
+            }
+        }
+
+        label(screen, box_.x_min, " -" + std::to_string(samples) + " samples");
+        label(screen, box_.x_max - 2, "now");
+    }
+
+  private:
+    const std::vector<std::unique_ptr<Devices::Device>> &_devices;
+    const std::vector<size_t> &_series;
+    std::vector<uint16_t> &_cells;
+    std::mutex &_hist_lock;
+
+    void draw(const std::vector<Devices::Graph::Column> &columns,
+              uint16_t color, int cells_x, int cells_y) {
+        const int height = 4 * cells_y;
+        int previous_low = std::clamp(columns[0].low, 0, height - 1);
+        int previous_high = std::clamp(columns[0].high, 0, height - 1);
+        for (int x = 0; x < 2 * cells_x; x++) {
+            int low = std::clamp(columns[x].low, 0, height - 1);
+            int high = std::clamp(columns[x].high, 0, height - 1);
+            // Reach back to the previous column so steps stay connected
+            int from = std::min(low, previous_high);
+            int to = std::max(high, previous_low);
+            previous_low = low;
+            previous_high = high;
+            for (int y = from; y <= to; y++) {
+                uint16_t &cell =
+                    _cells[(cells_y - 1 - y / 4) * cells_x + x / 2];
+                cell = color | (cell & 0xFF) |
+                       Devices::Graph::braille_dots[x % 2][y % 4];
+            }
+        }
+    }
+
+    void label(Screen &screen, int x, const std::string &label) {
+        for (char c : label) {
+            if (x > box_.x_max) {
+                break;
+            }
+            screen.PixelAt(x++, box_.y_max).character = c;
+        }
+    }
+};
+
+Devices::UI::CompareView::CompareView(
+    const std::vector<std::unique_ptr<Devices::Device>> &devices,
+    std::mutex &hist_lock)
+    : _devices(devices), _hist_lock(hist_lock) {
+    for (auto &device : devices) {
+        _menu_width = std::max(_menu_width,
+                               static_cast<int>(device->get_name().length()));
+    }
+    _menu_width += 5;
+    _menu_width = std::min(_menu_width, 50);
+    _list = Make<VirtualList>(
+        [this] { return _devices.size(); },
+        [this](size_t index, bool focused) {
+            auto it = std::find(_series.begin(), _series.end(), index);
+            Element entry =
+                text((it != _series.end() ? "[x] " : "[ ] ") +
+                     _devices[index]->get_name());
+            if (it != _series.end()) {
+                size_t index = (it - _series.begin()) % series_colors.size();
+                entry = entry | color(series_colors[index]);
+            }
+            return focused ? entry | inverted : entry;
+        },
+        1, &_list_selected);
+    _renderer = Renderer(_list, [this] {
+        TRACE_SPAN("CompareView");
+        Element graph;
+        if (_series.empty()) {
+            graph = text("Pick devices to compare with [space]") | center |
+                    flex;
+        } else {
+            Elements legend;
+            for (size_t s = 0; s < _series.size(); s++) {
+                legend.push_back(
+                    text(" ■ " + _devices[_series[s]]->get_name() + " ") |
+                    color(series_colors[s % series_colors.size()]));
+            }
+            graph = vbox({std::make_shared<OverlayGraph>(_devices, _series,
+                                                         _cells, _hist_lock),
+                          separator(), hflow(legend)}) |
+                    flex;
+        }
+        return hbox({
+                   _list->Render() | size(WIDTH, EQUAL, _menu_width),
+                   separator(),
+                   graph,
+               }) |
+               flex;
+    });
+    _renderer |= CatchEvent([this](Event event) {
+        if (event == Event::Character(' ') || event == Event::Return) {
+            if (_devices.empty()) {
+                return false;
+            }
+            size_t device = _list_selected;
+            auto it = std::find(_series.begin(), _series.end(), device);
+            if (it == _series.end()) {
+                _series.push_back(device);
+            } else {
+                _series.erase(it);
+            }
+            return true;
+        }
+        if (event == Event::Character('c')) {
+            _series.clear();
+            return true;
+        }
+        return false;
+    });
+}
+
+// Records from when the frame started being built until its last cell is
+// drawn, which is after the renderer returns. Layout and drawing also go in
+// the trace, the terminal write after that happens inside ftxui.
+class FrameTimer : public Node {
+  public:
+    FrameTimer(Element child, Devices::Perf::Clock::time_point start)
+        : Node({std::move(child)}), _start(start) {}
+
+    void ComputeRequirement() override {
+        _layout = Devices::Trace::Clock::now();
+        children_[0]->ComputeRequirement();
+        requirement_ = children_[0]->requirement();
+    }
+
+    void SetBox(Box box) override {
+        Node::SetBox(box);
+        children_[0]->SetBox(box);
+    }
+
+    void Render(Screen &screen) override {
+        children_[0]->Render(screen);
+        auto now = Devices::Perf::Clock::now();
+        Devices::Trace::record("draw", _layout, now);
+        if (Devices::Perf::enabled()) {
+            Devices::Perf::counters().ui_frame.record(now - _start);
+        }
+    }
+
+  private:
+    Devices::Perf::Clock::time_point _start;
+    Devices::Trace::Clock::time_point _layout;
+};
+
+std::string time_to_string(std::time_t time) {
+    if (time < 0) {
+        return "-";
+    }
+    std::tm tm;
+    localtime_r(&time, &tm);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%a %d %b %H:%M", &tm);
+    return buffer;
+}
+
+Devices::UI::ScheduleView::ScheduleView(
+    const std::vector<std::unique_ptr<Devices::Device>> &devices,
+    Devices::Schedule::Scheduler &scheduler)
+    : _devices(devices), _scheduler(scheduler) {
+    _renderer = Renderer([this] {
+        TRACE_SPAN("ScheduleView");
+        if (_scheduler.size() == 0) {
+            return text("No jobs scheduled") | center;
+        }
+        auto row = [](Element start, Element stop, Element job,
+                      Element actuator, Element value) {
+            return hbox({
+                start | size(WIDTH, EQUAL, 18),
+                separator(),
+                stop | size(WIDTH, EQUAL, 18),
+                separator(),
+                job | size(WIDTH, EQUAL, 24),
+                separator(),
+                actuator | size(WIDTH, EQUAL, 24),
+                separator(),
+                value | flex,
+            });
+        };
+        std::vector<Element> rows;
+        rows.push_back(row(text(" Start") | bold, text(" Stop") | bold,
+                           text(" Job") | bold, text(" Actuator") | bold,
+                           text(" Value") | bold));
+        rows.push_back(separator());
+        // Only as many entries as fit what we were given last frame
+        int visible = std::max(_box.y_max - _box.y_min + 1 - 2, 1);
+        for (const auto &entry :
+             _scheduler.upcoming(std::time(nullptr), visible)) {
+            const auto &job = *_scheduler.jobs()[entry.job];
+            Element element =
+                row(text(" " + time_to_string(entry.start)),
+                    text(" " + time_to_string(entry.stop)),
+                    text(" " + job.name),
+                    text(" " + _devices[job.actuator]->name),
+                    text(" " + float_to_string(job.value)));
+            rows.push_back(entry.running ? element | color(Color::Green1)
+                                         : element);
+        }
+        return vbox(rows) | flex | reflect(_box);
+    });
+}
+
+Devices::UI::MainView::MainView(
+    const std::vector<std::unique_ptr<Devices::Device>> &devices,
+    std::mutex &hist_lock, Devices::Schedule::Scheduler &scheduler,
+    Devices::Actuators::Queue &queue)
+    : _overview_view(OverviewView(devices, hist_lock)),
+      _details_view(DetailsView(devices, hist_lock, queue)),
+      _compare_view(CompareView(devices, hist_lock)),
+      _schedule_view(ScheduleView(devices, scheduler)) {
+    // Set up the main view components
+    _tab_toggle = Toggle(&_tabs, &_tab_selected);
+    _tab_container = Container::Tab(
+        {
+            _overview_view.get_renderer(),
+            _details_view.get_renderer(),
+            _compare_view.get_renderer(),
+            _schedule_view.get_renderer(),
+            Renderer([] {
+                TRACE_SPAN("DeviceConfigView");
+                return text("Device config content") | center;
+            }),
+        },
+        &_tab_selected);
+    _container = Container::Vertical({
+        _tab_toggle,
+        _tab_container,
+    });
+    _renderer = Renderer(_container, [this]() -> Element {
+        TRACE_SPAN("MainView");
+        bool overlay = _perf_overlay;
+        bool timed = Perf::enabled() || Trace::compiled_in;
+        auto start = timed ? Perf::Clock::now() : Perf::Clock::time_point();
+        auto view = vbox({
+                        _tab_toggle->Render(),
+                        separator(),
+                        _tab_container->Render(),
+                    }) |
+                    border;
+        if (overlay) {
+            view = dbox(
+                {view, hbox({filler(), vbox({perf_overlay(), filler()})})});
+        }
+        if (!timed) {
+            return view;
+        }
+        return std::make_shared<FrameTimer>(view, start);
+    });
+    _renderer |= CatchEvent([this](Event event) {
+        if (event == Event::Character('p')) {
+            _perf_overlay = !_perf_overlay;
+            if (_perf_overlay) {
+                Perf::enable();
+            } else {
+                Perf::disable();
+            }
+            _fps_since = Perf::Clock::now();
+            _fps_frames = 0;
+            return true;
+        }
+        return false;
+    });
+}
+
+Element Devices::UI::MainView::perf_overlay() {
+    using namespace std::chrono;
+    auto now = Perf::Clock::now();
+    _fps_frames++;
+    if (now - _fps_since >= seconds(1)) {
+        _fps = _fps_frames / duration<float>(now - _fps_since).count();
+        _fps_frames = 0;
+        _fps_since = now;
+    }
+    auto ms = [](nanoseconds ns) {
+        return text(float_to_string(ns.count() / 1e6f)) | align_right |
+               size(WIDTH, EQUAL, 8);
+    };
+    auto row = [&](const std::string &name, const Perf::Series &series) {
+        auto summary = series.summary();
+        return hbox({text(name) | size(WIDTH, EQUAL, 18), ms(summary.p50),
+                     ms(summary.p99), ms(summary.max), text(" ")});
+    };
+    auto &counters = Perf::counters();
+    uint64_t handled = counters.events_handled.load();
+    uint64_t posted = std::max(counters.events_posted.load(), handled);
+    return window(
+               text(" Performance [p] ") | bold,
+               vbox({
+                   text(" FPS: " + float_to_string(_fps)),
+                   hbox({text(" ms") | size(WIDTH, EQUAL, 18),
+                         text("p50") | align_right | size(WIDTH, EQUAL, 8),
+                         text("p99") | align_right | size(WIDTH, EQUAL, 8),
+                         text("max") | align_right | size(WIDTH, EQUAL, 8)}),
+                   row(" Frame", counters.ui_frame),
+                   row(" UI hist wait", counters.ui_hist_wait),
+                   row(" UI hist hold", counters.ui_hist_hold),
+                   row(" Record wait", counters.record_hist_wait),
+                   row(" Record hold", counters.record_hist_hold),
+                   row(" update_values", counters.update_values_pass),
+                   row(" record_to_hist", counters.record_to_hist_pass),
+                   text(" Queued redraws: " +
+                        std::to_string(posted - handled)),
+               })) |
+           clear_under;
+}
+
+// Shows a local pipeline or a remote client, which look the same from here,
+// until q is pressed or alive() turns false
+template <typename Source, typename Alive>
+void show(Source &source, int max_fps, Alive alive) {
+    using namespace Devices;
+    TRACE_THREAD("ui");
+    auto screen = ScreenInteractive::Fullscreen();
+    screen.TrackMouse(false);
+    std::atomic<bool> run = true;
+    Changes &changes = source.changes();
+    source.start();
+    std::thread refresh_ui([&]() {
+        TRACE_THREAD("refresh_ui");
+        using namespace std::chrono;
+        using namespace std::chrono_literals;
+        auto frame = microseconds(1000000 / std::max(max_fps, 1));
+        auto last_frame = steady_clock::now();
+        uint64_t seen = changes.generation();
+        while (run) {
+            if (!alive()) {
+                screen.ExitLoopClosure()();
+                break;
+            }
+            // Redraw at least once a second so the schedule clock moves
+            changes.wait(seen, 1000ms);
+            // Everything changing within the frame budget lands in one frame
+            std::this_thread::sleep_until(last_frame + frame);
+            seen = changes.generation();
+            last_frame = steady_clock::now();
+            Perf::counters().events_posted++;
+            screen.Post(Event::Custom);
+        }
+    });
+    auto catch_exit = ftxui::CatchEvent([&](Event event) {
+        if (event == Event::Custom) {
+            Perf::counters().events_handled++;
+            return false;
+        }
+        if (event == Event::Character('q')) {
+            screen.ExitLoopClosure()();
+            return true;
+        }
+        if (Trace::compiled_in && event == Event::Character('T')) {
+            Trace::dump(Trace::default_path);
+            return true;
+        }
+        return false;
+    });
+    UI::MainView main_view(source.devices(), source.hist_lock(),
+                           source.scheduler(), source.queue());
+    screen.Loop(main_view.get_renderer() | catch_exit);
+    run = false;
+    source.stop();
+    refresh_ui.join();
+    if (Trace::compiled_in && !Trace::dump(Trace::default_path)) {
+        std::cerr << "Failed to write " << Trace::default_path << std::endl;
+    }
+}
+
+void Devices::UI::run(Devices::Pipeline::Runner &pipeline, int max_fps) {
+    show(pipeline, max_fps, [] { return true; });
+}
+
+void Devices::UI::attach(Devices::Remote::Client &client, int max_fps) {
+    show(client, max_fps, [&] { return client.connected(); });
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+// Standard library headers
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ---- ftxui ----
+#include <ftxui/component/component.hpp>
+
+// Local headers
+#include "actuator.h"
+#include "control.h"
+#include "devices.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "remote.h"
+#include "schedule.h"
+
+namespace Devices {
+
+namespace UI {
+
+using namespace ftxui;
+
+// Detail view of one device, built once and kept while it's in use
+Component device_detailed(const Devices::Device &device, std::mutex &hist_lock);
+// Formatted value, minimum and maximum of an overview row, kept between
+// frames so unchanged numbers aren't formatted again
+struct OverviewText {
+    FloatMemo value;
+    FloatMemo min;
+    FloatMemo max;
+};
+
+// One overview row. Reads the history for its sparkline, so the caller holds
+// the history lock.
+Element device_overview(const Devices::Device &device, bool focused,
+                        OverviewText &texts);
+// Threshold colors for the graph axis
+Decorator device_thresholds(const Devices::Device &device);
+
+// Vertical list that only builds the rows in view plus a little overscan,
+// so a frame costs the same for ten devices or ten thousand. Every row is
+// row_height lines tall, which is what lets it find the viewport without
+// laying out the rest.
+class VirtualList : public ComponentBase {
+  public:
+    using RowFunction = std::function<Element(size_t index, bool focused)>;
+
+    VirtualList(std::function<size_t()> size, RowFunction row, int row_height,
+                int *selected)
+        : _size(size), _row(row), _row_height(row_height),
+          _selected(selected) {}
+
+    Element OnRender() override;
+    bool OnEvent(Event event) override;
+    bool Focusable() const override { return _size() > 0; }
+
+  private:
+    static const int overscan = 1;
+
+    std::function<size_t()> _size;
+    RowFunction _row;
+    int _row_height;
+    int *_selected;
+    // First row in view
+    int _offset = 0;
+    // Space given to the list last frame
+    Box _box;
+
+    int visible_rows() const;
+};
+
+class DetailsView {
+  public:
+    DetailsView(const std::vector<std::unique_ptr<Devices::Device>> &devices,
+                std::mutex &hist_lock, Devices::Actuators::Queue &queue);
+    Component get_renderer() { return _renderer; };
+
+  private:
+    const std::vector<std::unique_ptr<Devices::Device>> &_devices;
+    Component _renderer;
+
+    // Variables for the tab view
+    int _tab_selected = 0;
+    int _menu_width = 0;
+    Component _tab_toggle;
+
+    // Detail views are built the first time a device is selected and only
+    // the most recently viewed ones are kept, front is newest
+    static const size_t max_tab_views = 16;
+    std::list<std::pair<size_t, Component>> _tab_views;
+    std::unordered_map<size_t,
+                       std::list<std::pair<size_t, Component>>::iterator>
+        _tab_view_index;
+    Component tab_view(size_t device);
+
+    // Devices history lock
+    std::mutex &_hist_lock;
+
+    // Commands for InOut devices
+    Devices::Actuators::Queue &_queue;
+};
+
+class OverviewView {
+  public:
+    OverviewView(const std::vector<std::unique_ptr<Devices::Device>> &devices,
+                 std::mutex &hist_lock);
+    Component get_renderer() { return _renderer; };
+
+  private:
+    const std::vector<std::unique_ptr<Devices::Device>> &_devices;
+    Component _renderer;
+
+    // Variable for focused devices
+    int _device_selected = 0;
+    Component _list;
+    // One per device, only touched while rendering
+    std::vector<OverviewText> _texts;
+
+    // Devices history lock
+    std::mutex &_hist_lock;
+};
+
+// Overlays the normalized history of any number of devices on one graph.
+// Every device records a sample at the same time, so sample n is the same
+// moment for all of them and their columns share one time axis.
+class CompareView {
+  public:
+    CompareView(const std::vector<std::unique_ptr<Devices::Device>> &devices,
+                std::mutex &hist_lock);
+    Component get_renderer() { return _renderer; };
+
+  private:
+    const std::vector<std::unique_ptr<Devices::Device>> &_devices;
+    Component _renderer;
+
+    int _menu_width = 0;
+    int _list_selected = 0;
+    Component _list;
+    // Compared devices in the order they were picked, which sets their color
+    std::vector<size_t> _series;
+    // Dot bits and color of every graph cell, kept between frames
+    std::vector<uint16_t> _cells;
+
+    // Devices history lock
+    std::mutex &_hist_lock;
+};
+
+class ScheduleView {
+  public:
+    ScheduleView(const std::vector<std::unique_ptr<Devices::Device>> &devices,
+                 Devices::Schedule::Scheduler &scheduler);
+    Component get_renderer() { return _renderer; };
+
+  private:
+    const std::vector<std::unique_ptr<Devices::Device>> &_devices;
+    Devices::Schedule::Scheduler &_scheduler;
+    Component _renderer;
+
+    // Space given to the timeline last frame, only that many rows are built
+    Box _box;
+};
+
+class MainView {
+  public:
+    MainView(const std::vector<std::unique_ptr<Devices::Device>> &devices,
+             std::mutex &hist_lock, Devices::Schedule::Scheduler &scheduler,
+             Devices::Actuators::Queue &queue);
+    Component get_renderer() { return _renderer; };
+    // Index into the tabs, for driving the view without a terminal
+    void set_tab(int tab) { _tab_selected = tab; }
+
+  private:
+    Component _renderer;
+
+    // Variables for the tab view
+    int _tab_selected = 0;
+    const std::vector<std::string> _tabs = {" Overview ", " Devices ",
+                                            " Compare ", " Schedule ",
+                                            " Device Config "};
+    Component _tab_toggle;
+    Component _tab_container;
+    Component _container;
+
+    // Overview view
+    OverviewView _overview_view;
+    DetailsView _details_view;
+    CompareView _compare_view;
+    ScheduleView _schedule_view;
+
+    // Performance overlay, toggled with p
+    bool _perf_overlay = false;
+    Perf::Clock::time_point _fps_since;
+    int _fps_frames = 0;
+    float _fps = 0.0f;
+    Element perf_overlay();
+};
+
+// Starts the pipeline, shows it until q is pressed and stops it again
+void run(Devices::Pipeline::Runner &pipeline, int max_fps = 20);
+// Follows a pipeline served elsewhere until q is pressed or it goes away
+void attach(Devices::Remote::Client &client, int max_fps = 20);
+
+} // namespace UI
+
+} // namespace Devices